@@ -1,11 +1,27 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <limits>
+#if defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMIC_ARRAY_HAVE_SSE2 1
+#endif
 
 class DynamicArray {
+public:
+    enum class Arithmetic { Wrapping, Saturating };
+
 private:
     int* data_;
     size_t size_;
+    size_t capacity_;
 
     static void checkValueRange(int value) {
         if (value < -100 || value > 100) {
@@ -19,9 +35,131 @@ private:
         }
     }
 
+    void reallocate(size_t newCapacity) {
+        int* new_data = (newCapacity > 0) ? new int[newCapacity] : nullptr;
+        std::copy(data_, data_ + size_, new_data);
+        delete[] data_;
+        data_ = new_data;
+        capacity_ = newCapacity;
+    }
+
+    static int saturate(long long value) {
+        return (value < -100) ? -100 : (value > 100) ? 100 : static_cast<int>(value);
+    }
+
+    static int wrap(unsigned value) {
+        return static_cast<int>(value);
+    }
+
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+    // Four int lanes with the operators the arithmetic lambdas use; lane
+    // arithmetic wraps like unsigned int. Saturating lanes hold any scalar
+    // they meet (alpha, factor) to +-kLaneClamp, so while the elements stay
+    // within +-kLaneLimit no lane overflows and every result saturates as
+    // it would in long long. x86-64 always has SSE2, so no compiler flags
+    // are needed.
+    static const int kLaneLimit = 1 << 14;
+    static const int kLaneClamp = kLaneLimit + 101;
+
+    template <bool Saturating>
+    struct Lanes {
+        __m128i v;
+
+        explicit Lanes(__m128i value) : v(value) {}
+        explicit Lanes(int value)
+            : v(_mm_set1_epi32(!Saturating ? value
+                               : (value < -kLaneClamp) ? -kLaneClamp : (value > kLaneClamp) ? kLaneClamp : value)) {}
+
+        static Lanes load(const int* from) { return Lanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(from))); }
+        void store(int* to) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(to), v); }
+
+        bool fits() const {
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(v, _mm_set1_epi32(kLaneLimit)),
+                                           _mm_cmplt_epi32(v, _mm_set1_epi32(-kLaneLimit)));
+            return _mm_movemask_epi8(outside) == 0;
+        }
+
+        Lanes clamp(int low, int high) const {
+            __m128i lowLanes = _mm_set1_epi32(low), highLanes = _mm_set1_epi32(high);
+            __m128i below = _mm_cmplt_epi32(v, lowLanes);
+            __m128i value = _mm_or_si128(_mm_and_si128(below, lowLanes), _mm_andnot_si128(below, v));
+            __m128i above = _mm_cmpgt_epi32(value, highLanes);
+            return Lanes(_mm_or_si128(_mm_and_si128(above, highLanes), _mm_andnot_si128(above, value)));
+        }
+
+        friend Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm_add_epi32(a.v, b.v)); }
+        friend Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm_sub_epi32(a.v, b.v)); }
+
+        // SSE2 only multiplies lanes 0 and 2; lanes 1 and 3 are shifted down for a second pass
+        friend Lanes operator*(Lanes a, Lanes b) {
+            __m128i even = _mm_mul_epu32(a.v, b.v);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+            return Lanes(_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+        }
+    };
+
+    static Lanes<true> saturate(Lanes<true> value) {
+        return value.clamp(-100, 100);
+    }
+#endif
+
+    template <typename Op>
+    void transform(size_t begin, Arithmetic mode, Op op) {
+        int* data = data_;
+        size_t i = begin;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) { data[k] = saturate(op(static_cast<long long>(data[k]))); };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) {
+                Lanes<true> value = Lanes<true>::load(data + i);
+                if (value.fits()) saturate(op(value)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < size_; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) op(Lanes<false>::load(data + i)).store(data + i);
+#endif
+            for (; i < size_; ++i) data[i] = wrap(op(static_cast<unsigned>(data[i])));
+        }
+    }
+
+    template <typename Op>
+    void combine(const DynamicArray& other, Arithmetic mode, Op op) {
+        size_t overlap = std::min(size_, other.size_);
+        int* data = data_;
+        const int* src = other.data_;
+        size_t i = 0;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) {
+                data[k] = saturate(op(static_cast<long long>(data[k]), static_cast<long long>(src[k])));
+            };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                Lanes<true> a = Lanes<true>::load(data + i), b = Lanes<true>::load(src + i);
+                if (a.fits() && b.fits()) saturate(op(a, b)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < overlap; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                op(Lanes<false>::load(data + i), Lanes<false>::load(src + i)).store(data + i);
+            }
+#endif
+            for (; i < overlap; ++i) {
+                data[i] = wrap(op(static_cast<unsigned>(data[i]), static_cast<unsigned>(src[i])));
+            }
+        }
+        transform(overlap, mode, [op](auto value) { return op(value, decltype(value)(0)); });
+    }
+
 public:
     explicit DynamicArray(size_t size = 0)
-        : data_(nullptr), size_(size)
+        : data_(nullptr), size_(size), capacity_(size)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -34,7 +172,7 @@ public:
     }
 
     DynamicArray(const DynamicArray& other)
-        : data_(nullptr), size_(other.size_)
+        : data_(nullptr), size_(other.size_), capacity_(other.size_)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -44,19 +182,62 @@ public:
 
     DynamicArray& operator=(const DynamicArray& other) {
         if (this == &other) return *this;
-        int* new_data = nullptr;
-        if (other.size_ > 0) {
-            new_data = new int[other.size_];
-            std::copy(other.data_, other.data_ + other.size_, new_data);
+        if (other.size_ <= capacity_) {
+            std::copy(other.data_, other.data_ + other.size_, data_);
+            size_ = other.size_;
+            return *this;
         }
+        int* new_data = new int[other.size_];
+        std::copy(other.data_, other.data_ + other.size_, new_data);
         delete[] data_;
         data_ = new_data;
         size_ = other.size_;
+        capacity_ = other.size_;
+        return *this;
+    }
+
+    DynamicArray(DynamicArray&& other) noexcept
+        : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    DynamicArray& operator=(DynamicArray&& other) noexcept {
+        if (this == &other) return *this;
+        delete[] data_;
+        data_ = other.data_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
         return *this;
     }
 
+    void swap(DynamicArray& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    friend void swap(DynamicArray& a, DynamicArray& b) noexcept {
+        a.swap(b);
+    }
+
     size_t size() const { return size_; }
 
+    size_t capacity() const { return capacity_; }
+
+    void reserve(size_t newCapacity) {
+        if (newCapacity > capacity_) reallocate(newCapacity);
+    }
+
+    void shrink_to_fit() {
+        if (capacity_ > size_) reallocate(size_);
+    }
+
     int get(size_t idx) const {
         checkIndex(idx, size_);
         return data_[idx];
@@ -79,25 +260,41 @@ public:
 
     void append(int value) {
         checkValueRange(value);
-        int* new_data = new int[size_ + 1];
-        for (size_t i = 0; i < size_; ++i) new_data[i] = data_[i];
-        new_data[size_] = value;
-        delete[] data_;
-        data_ = new_data;
-        ++size_;
+        if (size_ == capacity_) reallocate(std::max<size_t>(4, capacity_ * 2));
+        data_[size_++] = value;
     }
 
-    void add(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            data_[i] += otherVal;
-        }
+    void add(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a + b; });
     }
 
-    void subtract(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            data_[i] -= otherVal;
+    void subtract(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a - b; });
+    }
+
+    void multiply(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a * b; });
+    }
+
+    void axpy(int alpha, const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [alpha](auto a, auto b) { return a + static_cast<decltype(a)>(alpha) * b; });
+    }
+
+    void scale(int factor, Arithmetic mode = Arithmetic::Wrapping) {
+        transform(0, mode, [factor](auto value) { return value * static_cast<decltype(value)>(factor); });
+    }
+
+    void clamp(int low, int high) {
+        if (low > high) {
+            throw std::invalid_argument("Clamp bounds must satisfy low <= high.");
+        }
+        int* data = data_;
+        size_t i = 0;
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+        for (; i + 4 <= size_; i += 4) Lanes<false>::load(data + i).clamp(low, high).store(data + i);
+#endif
+        for (; i < size_; ++i) {
+            data[i] = (data[i] < low) ? low : (data[i] > high) ? high : data[i];
         }
     }
 
@@ -110,6 +307,322 @@ public:
         return data_[idx];
     }
 
+    int& unchecked(size_t idx) { return data_[idx]; }
+    const int& unchecked(size_t idx) const { return data_[idx]; }
+
+    int* data() { return data_; }
+    const int* data() const { return data_; }
+
+    int* begin() { return data_; }
+    int* end() { return data_ + size_; }
+    const int* begin() const { return data_; }
+    const int* end() const { return data_ + size_; }
+
+#ifdef __cpp_lib_span
+    std::span<int> span() { return std::span<int>(data_, size_); }
+    std::span<const int> span() const { return std::span<const int>(data_, size_); }
+#endif
+
+};
+
+class CompactDynamicArray {
+public:
+    using Arithmetic = DynamicArray::Arithmetic;
+
+private:
+    std::int8_t* narrow_;
+    int* wide_;
+    size_t size_;
+    size_t capacity_;
+
+    static void checkValueRange(int value) {
+        if (value < -100 || value > 100) {
+            throw std::invalid_argument("Value must be in range [-100, 100].");
+        }
+    }
+
+    static void checkIndex(size_t idx, size_t size) {
+        if (idx >= size) {
+            throw std::out_of_range("Index out of range.");
+        }
+    }
+
+    static bool fitsNarrow(long long value) {
+        return value >= std::numeric_limits<std::int8_t>::min() &&
+               value <= std::numeric_limits<std::int8_t>::max();
+    }
+
+    template <typename T>
+    static T* copyInto(const T* data, size_t count, size_t newCapacity) {
+        T* new_data = (newCapacity > 0) ? new T[newCapacity] : nullptr;
+        std::copy(data, data + count, new_data);
+        return new_data;
+    }
+
+    int load(size_t idx) const {
+        return wide_ ? wide_[idx] : narrow_[idx];
+    }
+
+    void store(size_t idx, int value) {
+        if (!wide_ && !fitsNarrow(value)) widen();
+        if (wide_) wide_[idx] = value;
+        else narrow_[idx] = static_cast<std::int8_t>(value);
+    }
+
+    // Switches to int storage for good; values outside int8_t need it.
+    void widen() {
+        wide_ = new int[std::max<size_t>(capacity_, 1)];
+        std::copy(narrow_, narrow_ + size_, wide_);
+        delete[] narrow_;
+        narrow_ = nullptr;
+    }
+
+    void reallocate(size_t newCapacity) {
+        if (wide_) {
+            int* new_data = copyInto(wide_, size_, std::max<size_t>(newCapacity, 1));
+            delete[] wide_;
+            wide_ = new_data;
+        } else {
+            std::int8_t* new_data = copyInto(narrow_, size_, newCapacity);
+            delete[] narrow_;
+            narrow_ = new_data;
+        }
+        capacity_ = newCapacity;
+    }
+
+    static int saturate(long long value) {
+        return (value < -100) ? -100 : (value > 100) ? 100 : static_cast<int>(value);
+    }
+
+    static int wrap(unsigned value) {
+        return static_cast<int>(value);
+    }
+
+    // Wrapping results are checked against int8_t before anything is
+    // written; saturated ones always fit.
+    template <typename T, typename Op>
+    bool staysNarrow(const T* other, size_t count, Op op) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (!fitsNarrow(wrap(op(static_cast<unsigned>(narrow_[i]), static_cast<unsigned>(other[i]))))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T, typename U, typename Op>
+    static void accumulate(T* data, const U* other, size_t count, Arithmetic mode, Op op) {
+        if (mode == Arithmetic::Saturating) {
+            for (size_t i = 0; i < count; ++i) {
+                data[i] = static_cast<T>(saturate(op(static_cast<long long>(data[i]), static_cast<long long>(other[i]))));
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                data[i] = static_cast<T>(wrap(op(static_cast<unsigned>(data[i]), static_cast<unsigned>(other[i]))));
+            }
+        }
+    }
+
+    template <typename T, typename Op>
+    static void apply(T* data, size_t begin, size_t end, Arithmetic mode, Op op) {
+        if (mode == Arithmetic::Saturating) {
+            for (size_t i = begin; i < end; ++i) data[i] = static_cast<T>(saturate(op(static_cast<long long>(data[i]))));
+        } else {
+            for (size_t i = begin; i < end; ++i) data[i] = static_cast<T>(wrap(op(static_cast<unsigned>(data[i]))));
+        }
+    }
+
+    template <typename Op>
+    void transform(size_t begin, Arithmetic mode, Op op) {
+        if (!wide_ && mode == Arithmetic::Wrapping) {
+            for (size_t i = begin; i < size_; ++i) {
+                if (!fitsNarrow(wrap(op(static_cast<unsigned>(narrow_[i]))))) {
+                    widen();
+                    break;
+                }
+            }
+        }
+        if (wide_) apply(wide_, begin, size_, mode, op);
+        else apply(narrow_, begin, size_, mode, op);
+    }
+
+    template <typename Op>
+    void combine(const CompactDynamicArray& other, Arithmetic mode, Op op) {
+        size_t count = std::min(size_, other.size_);
+        if (!wide_ && mode == Arithmetic::Wrapping) {
+            bool narrow = other.wide_ ? staysNarrow(other.wide_, count, op)
+                                      : staysNarrow(other.narrow_, count, op);
+            if (!narrow) widen();
+        }
+        if (wide_) {
+            if (other.wide_) accumulate(wide_, other.wide_, count, mode, op);
+            else accumulate(wide_, other.narrow_, count, mode, op);
+        } else {
+            if (other.wide_) accumulate(narrow_, other.wide_, count, mode, op);
+            else accumulate(narrow_, other.narrow_, count, mode, op);
+        }
+        transform(count, mode, [op](auto value) { return op(value, decltype(value)(0)); });
+    }
+
+    template <typename T>
+    static void clampRange(T* data, size_t count, int low, int high) {
+        for (size_t i = 0; i < count; ++i) {
+            data[i] = static_cast<T>((data[i] < low) ? low : (data[i] > high) ? high : data[i]);
+        }
+    }
+
+public:
+    class Reference {
+    public:
+        Reference(CompactDynamicArray& owner, size_t idx) : owner_(owner), idx_(idx) {}
+
+        operator int() const { return owner_.load(idx_); }
+
+        Reference& operator=(int value) {
+            owner_.store(idx_, value);
+            return *this;
+        }
+        Reference& operator=(const Reference& other) { return *this = static_cast<int>(other); }
+        Reference& operator+=(int value) { return *this = static_cast<int>(*this) + value; }
+        Reference& operator-=(int value) { return *this = static_cast<int>(*this) - value; }
+
+    private:
+        CompactDynamicArray& owner_;
+        size_t idx_;
+    };
+
+    explicit CompactDynamicArray(size_t size = 0)
+        : narrow_(nullptr), wide_(nullptr), size_(size), capacity_(size)
+    {
+        if (size_ > 0) {
+            narrow_ = new std::int8_t[size_];
+            std::fill(narrow_, narrow_ + size_, 0);
+        }
+    }
+
+    ~CompactDynamicArray() {
+        delete[] narrow_;
+        delete[] wide_;
+    }
+
+    CompactDynamicArray(const CompactDynamicArray& other)
+        : narrow_(nullptr), wide_(nullptr), size_(other.size_), capacity_(other.size_)
+    {
+        if (other.wide_) wide_ = copyInto(other.wide_, size_, std::max<size_t>(size_, 1));
+        else narrow_ = copyInto(other.narrow_, size_, size_);
+    }
+
+    CompactDynamicArray& operator=(const CompactDynamicArray& other) {
+        if (this == &other) return *this;
+        CompactDynamicArray copy(other);
+        swap(copy);
+        return *this;
+    }
+
+    CompactDynamicArray(CompactDynamicArray&& other) noexcept
+        : narrow_(other.narrow_), wide_(other.wide_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.narrow_ = nullptr;
+        other.wide_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    CompactDynamicArray& operator=(CompactDynamicArray&& other) noexcept {
+        if (this == &other) return *this;
+        CompactDynamicArray moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+
+    void swap(CompactDynamicArray& other) noexcept {
+        std::swap(narrow_, other.narrow_);
+        std::swap(wide_, other.wide_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    friend void swap(CompactDynamicArray& a, CompactDynamicArray& b) noexcept {
+        a.swap(b);
+    }
+
+    size_t size() const { return size_; }
+
+    size_t capacity() const { return capacity_; }
+
+    bool isCompact() const { return wide_ == nullptr; }
+
+    void reserve(size_t newCapacity) {
+        if (newCapacity > capacity_) reallocate(newCapacity);
+    }
+
+    void shrink_to_fit() {
+        if (capacity_ > size_) reallocate(size_);
+    }
+
+    int get(size_t idx) const {
+        checkIndex(idx, size_);
+        return load(idx);
+    }
+
+    void set(size_t idx, int value) {
+        checkIndex(idx, size_);
+        checkValueRange(value);
+        store(idx, value);
+    }
+
+    void print() const {
+        std::cout << "{ ";
+        for (size_t i = 0; i < size_; ++i) {
+            std::cout << load(i);
+            if (i + 1 < size_) std::cout << ", ";
+        }
+        std::cout << " } (size=" << size_ << ")\n";
+    }
+
+    void append(int value) {
+        checkValueRange(value);
+        if (size_ == capacity_) reallocate(std::max<size_t>(4, capacity_ * 2));
+        store(size_++, value);
+    }
+
+    void add(const CompactDynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a + b; });
+    }
+
+    void subtract(const CompactDynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a - b; });
+    }
+
+    void multiply(const CompactDynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a * b; });
+    }
+
+    void axpy(int alpha, const CompactDynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [alpha](auto a, auto b) { return a + static_cast<decltype(a)>(alpha) * b; });
+    }
+
+    void scale(int factor, Arithmetic mode = Arithmetic::Wrapping) {
+        transform(0, mode, [factor](auto value) { return value * static_cast<decltype(value)>(factor); });
+    }
+
+    void clamp(int low, int high) {
+        if (low > high) {
+            throw std::invalid_argument("Clamp bounds must satisfy low <= high.");
+        }
+        if (!wide_ && size_ > 0 && (low > std::numeric_limits<int8_t>::max() || high < std::numeric_limits<int8_t>::min())) widen();
+        if (wide_) clampRange(wide_, size_, low, high);
+        else clampRange(narrow_, size_, low, high);
+    }
+
+    Reference operator[](size_t idx) {
+        checkIndex(idx, size_);
+        return Reference(*this, idx);
+    }
+    int operator[](size_t idx) const {
+        checkIndex(idx, size_);
+        return load(idx);
+    }
 };
 
 int main() {
@@ -137,6 +650,15 @@ std::cout << "After a.add(b): "; a.print();
 
         DynamicArray c = a;
         std::cout << "Copy c = a: "; c.print();
+
+        CompactDynamicArray d(3);
+        d.set(0, 100);
+        d.set(1, -50);
+        d.set(2, 7);
+        std::cout << "Compact d: "; d.print();
+
+        d.add(d);
+        std::cout << "After d.add(d): "; d.print();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
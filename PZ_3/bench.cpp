@@ -0,0 +1,616 @@
+#include "image_processor.h"
+
+#include <cstdlib>
+#include <limits>
+
+// Times the pipeline operations on synthetic images and checks every
+// optimized engine against the reference output. Build next to main.cpp:
+//     g++ -std=c++17 -O2 -pthread -o bench bench.cpp
+// Usage:
+//     bench [--sizes 256,1024,4096,8192] [--threads 1,4] [--reps 7]
+//           [--depth 8|16] [--csv results.csv] [--check-only]
+// The exit status is non-zero when a check fails.
+
+namespace Bench {
+    using namespace ImageProcessor;
+
+    const uint64_t kImageSeed = 20240917;
+    const uint64_t kNoiseSeed = 7;
+    // The sorting median is only timed up to this size; beyond it a single
+    // run takes minutes and the other engines are what matters.
+    const int kMaxSortSize = 1024;
+
+    // Metric results are stored here so the calls cannot be optimized away.
+    volatile double sink = 0.0;
+
+    struct Options {
+        std::vector<int> sizes = { 256, 1024, 4096, 8192 };
+        std::vector<int> threads;
+        int reps = 7;
+        int depth = 8;
+        std::string csvPath;
+        std::string dataFolder = "bench_data";
+        bool checkOnly = false;
+    };
+
+    std::vector<int> parseList(const std::string& text) {
+        std::vector<int> values;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) values.push_back(std::atoi(item.c_str()));
+        }
+        return values;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--sizes" && hasValue) {
+                options.sizes = parseList(argv[++i]);
+            } else if (arg == "--threads" && hasValue) {
+                options.threads = parseList(argv[++i]);
+            } else if (arg == "--reps" && hasValue) {
+                options.reps = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--depth" && hasValue) {
+                options.depth = std::atoi(argv[++i]);
+            } else if (arg == "--csv" && hasValue) {
+                options.csvPath = argv[++i];
+            } else if (arg == "--data" && hasValue) {
+                options.dataFolder = argv[++i];
+            } else if (arg == "--check-only") {
+                options.checkOnly = true;
+            } else {
+                std::cout << "Unknown argument: " << arg << std::endl;
+                return false;
+            }
+        }
+        if (options.threads.empty()) {
+            int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+            options.threads = { 1 };
+            if (hardware > 1) options.threads.push_back(hardware);
+        }
+        return options.depth == 8 || options.depth == 16;
+    }
+
+    // A smooth pattern with a ramp plus per-pixel texture from a counter
+    // hash, so every size and depth is reproducible on any platform.
+    bool writeSyntheticImage(const std::string& path, int width, int height, int maxValue, uint64_t seed) {
+        PGMRowWriter writer;
+        if (!writer.open(path, PGMFormat::Binary, width, height, maxValue)) return false;
+
+        std::vector<uint16_t> line16(width);
+        std::vector<uint8_t> line8(width);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double base = 0.45 + 0.3 * std::sin(x * 0.05) * std::cos(y * 0.07) + 0.2 * (x + y) / (width + height);
+                uint64_t bits = mix64(seed ^ (static_cast<uint64_t>(y) * width + x) * 0x9E3779B97F4A7C15ull);
+                double texture = (static_cast<double>(bits % 41) - 20.0) / 255.0;
+                double value = std::min(1.0, std::max(0.0, base + texture)) * maxValue;
+                line16[x] = static_cast<uint16_t>(value + 0.5);
+                line8[x] = static_cast<uint8_t>(line16[x]);
+            }
+            if (maxValue > 255) {
+                writer.writeRow(line16.data());
+            } else {
+                writer.writeRow(line8.data());
+            }
+        }
+        return writer.close();
+    }
+
+    struct Timing {
+        double median, p10, p90;
+    };
+
+    // Runs setup() untimed and then run() timed, reps times, and reports
+    // nearest-rank percentiles of the run times in milliseconds.
+    template <typename Setup, typename Run>
+    Timing measure(int reps, Setup&& setup, Run&& run) {
+        std::vector<double> times;
+        for (int i = 0; i < reps; ++i) {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            run();
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::sort(times.begin(), times.end());
+        auto percentile = [&](double p) {
+            size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * times.size()));
+            return times[std::min(times.size() - 1, std::max<size_t>(rank, 1) - 1)];
+        };
+        return Timing{ percentile(50), percentile(10), percentile(90) };
+    }
+
+    class Report {
+    private:
+        std::ofstream csv;
+
+    public:
+        explicit Report(const std::string& csvPath) {
+            std::cout << "operation        size  param  engine     threads   median ms      p10 ms      p90 ms    Mpx/s"
+                      << std::endl;
+            if (csvPath.empty()) return;
+            csv.open(csvPath, std::ios::trunc);
+            csv << "Operation,Size,Param,Engine,Threads,MedianMs,P10Ms,P90Ms,MPixelsPerSecond\n";
+        }
+
+        void add(const std::string& operation, int size, const std::string& param, const std::string& engine,
+                 int threads, const Timing& timing) {
+            double rate = static_cast<double>(size) * size / (timing.median * 1e3);
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-15s %5d  %-5s  %-9s  %7d  %10.3f  %10.3f  %10.3f  %7.1f",
+                          operation.c_str(), size, param.c_str(), engine.c_str(), threads,
+                          timing.median, timing.p10, timing.p90, rate);
+            std::cout << line << std::endl;
+            if (csv.is_open()) {
+                csv << operation << "," << size << "," << param << "," << engine << "," << threads << ","
+                    << timing.median << "," << timing.p10 << "," << timing.p90 << "," << rate << "\n";
+            }
+        }
+    };
+
+    const char* engineName(MedianEngine engine) {
+        switch (engine) {
+        case MedianEngine::Sort: return "sort";
+        case MedianEngine::Histogram: return "histogram";
+        case MedianEngine::Network: return "network";
+        default: return "auto";
+        }
+    }
+
+    // Whether engine really runs for this window and depth, rather than
+    // falling back to another one.
+    bool engineAvailable(MedianEngine engine, int window, int maxValue) {
+        if (engine == MedianEngine::Network) return hasMedianNetwork(window);
+        if (engine == MedianEngine::Histogram) {
+            return (maxValue > 255) ? histogramBins<uint16_t>(maxValue) > 0 : true;
+        }
+        return true;
+    }
+
+    void benchmarkSize(const Options& options, int size, Report& report) {
+        int maxValue = (options.depth == 16) ? 65535 : 255;
+        std::string path = options.dataFolder + "/synthetic_" + std::to_string(size) + ".pgm";
+        std::string outputPath = options.dataFolder + "/output_" + std::to_string(size) + ".pgm";
+        if (!writeSyntheticImage(path, size, size, maxValue, kImageSeed)) {
+            std::cout << "Error writing: " << path << std::endl;
+            return;
+        }
+
+        PGMHandler source;
+        source.readFile(path);
+        PGMHandler noisy(source);
+        noisy.introduceNoise(0.05, kNoiseSeed);
+        PGMHandler work;
+        auto fresh = [&] { work = noisy; };
+        auto nothing = [] {};
+        const std::vector<int> windows = { 3, 5, 7 };
+
+        report.add("read", size, "-", "-", 1, measure(options.reps, nothing, [&] { work.readFile(path); }));
+        report.add("write", size, "-", "-", 1, measure(options.reps, nothing, [&] {
+            source.writeFile(outputPath, PGMFormat::Binary);
+        }));
+
+        for (int threads : options.threads) {
+            WorkerPool pool(threads);
+            bool serial = threads == 1;
+            auto resetSource = [&] { work = source; };
+
+            report.add("noise", size, "0.05", "-", threads, measure(options.reps, resetSource, [&] {
+                if (serial) work.introduceNoise(0.05, kNoiseSeed); else work.introduceNoise(0.05, kNoiseSeed, pool);
+            }));
+
+            for (int window : windows) {
+                for (MedianEngine engine : { MedianEngine::Sort, MedianEngine::Histogram, MedianEngine::Network }) {
+                    if (!engineAvailable(engine, window, maxValue)) continue;
+                    if (engine == MedianEngine::Sort && size > kMaxSortSize) continue;
+                    report.add("median", size, std::to_string(window), engineName(engine), threads,
+                               measure(options.reps, fresh, [&] {
+                                   if (serial) work.useMedianFilter(window, engine); else work.useMedianFilter(window, engine, pool);
+                               }));
+                }
+            }
+
+            report.add("adaptive", size, "7", "-", threads, measure(options.reps, fresh, [&] {
+                if (serial) work.useAdaptiveMedianFilter(7); else work.useAdaptiveMedianFilter(7, pool);
+            }));
+
+            report.add("quality", size, "-", "fused", threads, measure(options.reps, nothing, [&] {
+                sink = (serial ? computeQualityMetrics(source, noisy) : computeQualityMetrics(source, noisy, pool)).ssim;
+            }));
+            report.add("mssim", size, std::to_string(kSSIMWindow), "-", threads, measure(options.reps, nothing, [&] {
+                sink = serial ? computeWindowedSSIM(source, noisy) : computeWindowedSSIM(source, noisy, pool);
+            }));
+        }
+
+        for (int window : windows) {
+            report.add("box", size, std::to_string(window), "-", 1, measure(options.reps, fresh, [&] {
+                work.useBoxFilter(window);
+            }));
+            report.add("gaussian", size, std::to_string(window), "-", 1, measure(options.reps, fresh, [&] {
+                work.useGaussianFilter(gaussianSigma(window));
+            }));
+        }
+
+        // The sweep's windows map to sigmas below kMinBoxSigma, so the box
+        // passes are timed here against the direct kernel at larger sigmas.
+        // The kernel filters into its own plane first, so it may run in place.
+        for (double sigma : { kMinBoxSigma, 4.0, 8.0 }) {
+            std::ostringstream param;
+            param << "s" << sigma;
+            report.add("gaussian", size, param.str(), "boxes", 1, measure(options.reps, fresh, [&] {
+                work.useGaussianFilter(sigma);
+            }));
+            report.add("gaussian", size, param.str(), "kernel", 1, measure(options.reps, fresh, [&] {
+                work.visitPixels([&](auto& pixels) { gaussianKernelFilter(pixels.view(), pixels.writableView(), sigma); });
+            }));
+        }
+
+        report.add("mse", size, "-", "-", 1, measure(options.reps, nothing, [&] { sink = computeMSE(source, noisy); }));
+        report.add("psnr", size, "-", "-", 1, measure(options.reps, nothing, [&] { sink = computePSNR(source, noisy); }));
+        report.add("ssim", size, "-", "-", 1, measure(options.reps, nothing, [&] { sink = computeSSIM(source, noisy); }));
+
+        std::remove(path.c_str());
+        std::remove(outputPath.c_str());
+    }
+
+    int maxDifference(const PGMHandler& a, const PGMHandler& b) {
+        if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) return std::numeric_limits<int>::max();
+        int worst = 0;
+        for (int y = 0; y < a.getHeight(); ++y) {
+            for (int x = 0; x < a.getWidth(); ++x) {
+                worst = std::max(worst, std::abs(a.getValue(x, y) - b.getValue(x, y)));
+            }
+        }
+        return worst;
+    }
+
+    class Checker {
+    private:
+        int failures = 0;
+
+    public:
+        void expect(bool passed, const std::string& name, const std::string& detail = "") {
+            if (!passed) ++failures;
+            std::cout << "check " << name << ": " << (passed ? "ok" : "FAILED") << (passed ? "" : detail) << std::endl;
+        }
+
+        void expectSame(const PGMHandler& actual, const PGMHandler& expected, const std::string& name, int tolerance = 0) {
+            int difference = maxDifference(actual, expected);
+            expect(difference <= tolerance, name, " (max difference " + std::to_string(difference) + ")");
+        }
+
+        void expectClose(double actual, double expected, const std::string& name, double tolerance = 1e-9) {
+            bool close = std::fabs(actual - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+            std::ostringstream detail;
+            detail.precision(17);
+            detail << " (" << actual << " vs " << expected << ")";
+            expect(close, name, detail.str());
+        }
+
+        int failed() const { return failures; }
+    };
+
+    ImageRect wholeImage(const PGMHandler& image) {
+        return ImageRect{ 0, 0, image.getWidth(), image.getHeight() };
+    }
+
+    // Direct mean over the window, clamped to rect, rounded like the filters
+    // round; pixels outside rect keep their values.
+    PGMHandler referenceBox(const PGMHandler& image, int window, PGMHandler result, const ImageRect& rect) {
+        int radius = window / 2;
+        int right = rect.x + rect.width - 1, bottom = rect.y + rect.height - 1;
+        result.visitPixels([&](auto& pixels) {
+            using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+            for (int y = rect.y; y <= bottom; ++y) {
+                Pixel* out = pixels.row(y);
+                for (int x = rect.x; x <= right; ++x) {
+                    double sum = 0.0;
+                    for (int dy = -radius; dy <= radius; ++dy) {
+                        for (int dx = -radius; dx <= radius; ++dx) {
+                            int sx = std::min(std::max(x + dx, rect.x), right);
+                            int sy = std::min(std::max(y + dy, rect.y), bottom);
+                            sum += image.getValue(sx, sy);
+                        }
+                    }
+                    out[x] = static_cast<Pixel>(sum / (window * window) + 0.5);
+                }
+            }
+        });
+        return result;
+    }
+
+    PGMHandler referenceBox(const PGMHandler& image, int window, PGMHandler result) {
+        return referenceBox(image, window, std::move(result), wholeImage(image));
+    }
+
+    // Samples as doubles, row by row, for the floating-point references.
+    std::vector<double> samplePlane(const PGMHandler& image) {
+        std::vector<double> plane;
+        for (int y = 0; y < image.getHeight(); ++y) {
+            for (int x = 0; x < image.getWidth(); ++x) plane.push_back(image.getValue(x, y));
+        }
+        return plane;
+    }
+
+    PGMHandler planeImage(const std::vector<double>& plane, PGMHandler result) {
+        int width = result.getWidth();
+        result.visitPixels([&](auto& pixels) {
+            using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+            for (int y = 0; y < result.getHeight(); ++y) {
+                Pixel* out = pixels.row(y);
+                for (int x = 0; x < width; ++x) out[x] = static_cast<Pixel>(plane[static_cast<size_t>(y) * width + x] + 0.5);
+            }
+        });
+        return result;
+    }
+
+    // Separable convolution with edges replicated, in double precision.
+    std::vector<double> convolvePlane(const std::vector<double>& plane, int width, int height,
+                                      const std::vector<double>& kernel) {
+        int radius = static_cast<int>(kernel.size()) / 2;
+        std::vector<double> rows(plane.size()), result(plane.size());
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double sum = 0.0;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += kernel[k + radius] * plane[static_cast<size_t>(y) * width + std::min(std::max(x + k, 0), width - 1)];
+                }
+                rows[static_cast<size_t>(y) * width + x] = sum;
+            }
+        }
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                double sum = 0.0;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += kernel[k + radius] * rows[static_cast<size_t>(std::min(std::max(y + k, 0), height - 1)) * width + x];
+                }
+                result[static_cast<size_t>(y) * width + x] = sum;
+            }
+        }
+        return result;
+    }
+
+    // The sampled Gaussian of gaussianKernelFilter, applied directly.
+    PGMHandler referenceGaussian(const PGMHandler& image, double sigma) {
+        int radius = std::max(1, static_cast<int>(std::ceil(3.0 * sigma)));
+        std::vector<double> kernel;
+        double total = 0.0;
+        for (int k = -radius; k <= radius; ++k) {
+            kernel.push_back(std::exp(-0.5 * k * k / (sigma * sigma)));
+            total += kernel.back();
+        }
+        for (double& weight : kernel) weight /= total;
+        return planeImage(convolvePlane(samplePlane(image), image.getWidth(), image.getHeight(), kernel), image);
+    }
+
+    // The box passes gaussianFilter uses for large sigmas, without the
+    // float intermediates.
+    PGMHandler referenceBoxGaussian(const PGMHandler& image, double sigma) {
+        std::vector<double> plane = samplePlane(image);
+        for (int radius : gaussianBoxRadii(sigma)) {
+            if (radius == 0) continue;
+            std::vector<double> kernel(2 * radius + 1, 1.0 / (2 * radius + 1));
+            plane = convolvePlane(plane, image.getWidth(), image.getHeight(), kernel);
+        }
+        return planeImage(plane, image);
+    }
+
+    // Straightforward switching median: each 0 or max-valued pixel of rect
+    // becomes the median of the other pixels in the smallest window, clipped
+    // to rect, that has any; the largest window falls back to all pixels.
+    PGMHandler referenceAdaptive(const PGMHandler& image, int maxWindow, const ImageRect& rect) {
+        PGMHandler result(image);
+        int high = image.getMaxValue();
+        int right = rect.x + rect.width - 1, bottom = rect.y + rect.height - 1;
+        auto impulse = [&](int value) { return value == 0 || value == high; };
+        result.visitPixels([&](auto& pixels) {
+            using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+            for (int y = rect.y; y <= bottom; ++y) {
+                for (int x = rect.x; x <= right; ++x) {
+                    if (!impulse(image.getValue(x, y))) continue;
+                    for (int radius = 1; radius <= maxWindow / 2; ++radius) {
+                        std::vector<int> values, all;
+                        for (int sy = std::max(rect.y, y - radius); sy <= std::min(bottom, y + radius); ++sy) {
+                            for (int sx = std::max(rect.x, x - radius); sx <= std::min(right, x + radius); ++sx) {
+                                int value = image.getValue(sx, sy);
+                                all.push_back(value);
+                                if (!impulse(value)) values.push_back(value);
+                            }
+                        }
+                        if (values.empty() && radius == maxWindow / 2) values = all;
+                        if (values.empty()) continue;
+                        std::sort(values.begin(), values.end());
+                        pixels.row(y)[x] = static_cast<Pixel>(values[values.size() / 2]);
+                        break;
+                    }
+                }
+            }
+        });
+        return result;
+    }
+
+    // Mean SSIM over every window-by-window block, each block measured on
+    // its own with two-pass means and (co)variances in long double.
+    double referenceWindowedSSIM(const PGMHandler& a, const PGMHandler& b, int window) {
+        long double peak = std::max(a.getMaxValue(), b.getMaxValue());
+        long double c1 = (0.01L * peak) * (0.01L * peak), c2 = (0.03L * peak) * (0.03L * peak);
+        long double n = static_cast<long double>(window) * window;
+        long double total = 0.0L;
+        int blocks = 0;
+        for (int y = 0; y + window <= a.getHeight(); ++y) {
+            for (int x = 0; x + window <= a.getWidth(); ++x) {
+                long double meanA = 0.0L, meanB = 0.0L;
+                for (int dy = 0; dy < window; ++dy) {
+                    for (int dx = 0; dx < window; ++dx) {
+                        meanA += a.getValue(x + dx, y + dy);
+                        meanB += b.getValue(x + dx, y + dy);
+                    }
+                }
+                meanA /= n;
+                meanB /= n;
+                long double varianceA = 0.0L, varianceB = 0.0L, covariance = 0.0L;
+                for (int dy = 0; dy < window; ++dy) {
+                    for (int dx = 0; dx < window; ++dx) {
+                        long double da = a.getValue(x + dx, y + dy) - meanA, db = b.getValue(x + dx, y + dy) - meanB;
+                        varianceA += da * da;
+                        varianceB += db * db;
+                        covariance += da * db;
+                    }
+                }
+                varianceA /= n;
+                varianceB /= n;
+                covariance /= n;
+                total += ((2.0L * meanA * meanB + c1) * (2.0L * covariance + c2)) /
+                         ((meanA * meanA + meanB * meanB + c1) * (varianceA + varianceB + c2));
+                ++blocks;
+            }
+        }
+        return static_cast<double>(total / blocks);
+    }
+
+    void checkDepth(Checker& checker, const Options& options, int maxValue) {
+        // Odd sizes leave partial SIMD blocks and uneven row tiles.
+        const int width = 203, height = 117;
+        std::string depth = (maxValue > 255) ? std::to_string(maxValue) : "255";
+        std::string path = options.dataFolder + "/check_" + depth + ".pgm";
+        std::string streamed = options.dataFolder + "/check_" + depth + "_streamed.pgm";
+        if (!writeSyntheticImage(path, width, height, maxValue, kImageSeed)) {
+            checker.expect(false, "write synthetic image " + path);
+            return;
+        }
+
+        PGMHandler source;
+        checker.expect(source.readFile(path), "read " + depth);
+        WorkerPool pool(3);
+
+        PGMHandler noisy(source), noisyPool(source);
+        noisy.introduceNoise(0.1, kNoiseSeed);
+        noisyPool.introduceNoise(0.1, kNoiseSeed, pool);
+        checker.expectSame(noisyPool, noisy, "noise threads " + depth);
+
+        for (int window : { 3, 5, 7, 9 }) {
+            std::string suffix = " w" + std::to_string(window) + " " + depth;
+            PGMHandler reference = noisy.medianFiltered(window, MedianEngine::Sort);
+            for (MedianEngine engine : { MedianEngine::Histogram, MedianEngine::Network, MedianEngine::Auto }) {
+                if (!engineAvailable(engine, window, maxValue)) continue;
+                checker.expectSame(noisy.medianFiltered(window, engine), reference,
+                                   std::string("median ") + engineName(engine) + suffix);
+                PGMHandler parallel(noisy);
+                parallel.useMedianFilter(window, engine, pool);
+                checker.expectSame(parallel, reference, std::string("median ") + engineName(engine) + " threads" + suffix);
+            }
+
+            PGMHandler fromStream;
+            bool ok = noisy.writeFile(path, PGMFormat::Binary) && streamMedianFilter(path, streamed, window) &&
+                      fromStream.readFile(streamed);
+            checker.expect(ok, "stream median io" + suffix);
+            if (ok) checker.expectSame(fromStream, reference, "stream median" + suffix);
+
+            checker.expectSame(noisy.boxFiltered(window), referenceBox(noisy, window, noisy), "box" + suffix);
+        }
+
+        for (int window : { 3, 5, 7 }) {
+            std::string suffix = " w" + std::to_string(window) + " " + depth;
+            PGMHandler reference = referenceAdaptive(noisy, window, wholeImage(noisy));
+            checker.expectSame(noisy.adaptiveMedianFiltered(window), reference, "adaptive" + suffix);
+            PGMHandler adaptive(noisy);
+            adaptive.useAdaptiveMedianFilter(window, pool);
+            checker.expectSame(adaptive, reference, "adaptive threads" + suffix);
+        }
+
+        // Float accumulation may round a sample the other way, hence the
+        // tolerance of one. The box passes only approximate the Gaussian,
+        // so they are also held to a looser bound against the exact one.
+        for (double sigma : { 0.8, 1.4, kMinBoxSigma, 3.5 }) {
+            std::ostringstream suffix;
+            suffix << " sigma " << sigma << " " << depth;
+            PGMHandler smoothed = noisy.gaussianFiltered(sigma);
+            if (sigma < kMinBoxSigma) {
+                checker.expectSame(smoothed, referenceGaussian(noisy, sigma), "gaussian kernel" + suffix.str(), 1);
+            } else {
+                checker.expectSame(smoothed, referenceBoxGaussian(noisy, sigma), "gaussian boxes" + suffix.str(), 1);
+                checker.expectSame(source.gaussianFiltered(sigma), referenceGaussian(source, sigma),
+                                   "gaussian boxes vs exact" + suffix.str(), maxValue / 25);
+            }
+        }
+
+        ImageRect rect{ 37, 21, 90, 61 };
+        PGMHandler region(noisy);
+        region.useBoxFilter(rect, 5);
+        checker.expectSame(region, referenceBox(noisy, 5, noisy, rect), "region box " + depth);
+        region = noisy;
+        region.useAdaptiveMedianFilter(rect, 7);
+        checker.expectSame(region, referenceAdaptive(noisy, 7, rect), "region adaptive " + depth);
+
+        PGMHandler filtered = noisy.medianFiltered(3);
+        QualityMetrics fused = computeQualityMetrics(source, filtered);
+        QualityMetrics fusedPool = computeQualityMetrics(source, filtered, pool);
+        checker.expectClose(fused.mse, computeMSE(source, filtered), "fused mse " + depth);
+        checker.expectClose(fused.psnr, computePSNR(source, filtered), "fused psnr " + depth);
+        checker.expectClose(fused.ssim, computeSSIM(source, filtered), "fused ssim " + depth);
+        checker.expectClose(fusedPool.mse, fused.mse, "fused mse threads " + depth);
+        checker.expectClose(computeWindowedSSIM(source, filtered, pool), computeWindowedSSIM(source, filtered),
+                            "mssim threads " + depth, 1e-12);
+        for (int window : { 3, kSSIMWindow }) {
+            checker.expectClose(computeWindowedSSIM(source, filtered, window), referenceWindowedSSIM(source, filtered, window),
+                                "mssim w" + std::to_string(window) + " " + depth);
+        }
+
+        // A window this large takes 16-bit sums past int64_t, onto WideSum.
+        if (maxValue > 4095) {
+            std::string widePath = options.dataFolder + "/check_" + depth + "_wide.pgm";
+            PGMHandler wide;
+            bool ok = writeSyntheticImage(widePath, 191, 187, maxValue, kImageSeed) && wide.readFile(widePath);
+            checker.expect(ok, "read wide " + depth);
+            if (ok) {
+                // Bright pixels push the window sums as high as they go.
+                wide.visitPixels([&](auto& pixels) {
+                    using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                    for (int y = 0; y < wide.getHeight(); ++y) {
+                        Pixel* line = pixels.row(y);
+                        for (int x = 0; x < wide.getWidth(); ++x) line[x] = static_cast<Pixel>(maxValue - (maxValue - line[x]) / 64);
+                    }
+                });
+                PGMHandler wideNoisy(wide);
+                wideNoisy.introduceNoise(0.01, kNoiseSeed);
+                checker.expectClose(computeWindowedSSIM(wide, wideNoisy, 185), referenceWindowedSSIM(wide, wideNoisy, 185),
+                                    "mssim w185 " + depth);
+            }
+            std::remove(widePath.c_str());
+        }
+
+        std::remove(path.c_str());
+        std::remove(streamed.c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    using namespace Bench;
+
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::cout << "Usage: bench [--sizes 256,1024] [--threads 1,4] [--reps 7] [--depth 8|16] "
+                     "[--csv file] [--data folder] [--check-only]" << std::endl;
+        return 2;
+    }
+    makeFolder(options.dataFolder);
+
+    Checker checker;
+    checkDepth(checker, options, 255);
+    checkDepth(checker, options, 4095);
+    checkDepth(checker, options, 65535);
+    if (checker.failed() > 0) {
+        std::cout << checker.failed() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    if (options.checkOnly) return 0;
+
+    Report report(options.csvPath);
+    for (int size : options.sizes) {
+        benchmarkSize(options, size, report);
+    }
+    return 0;
+}
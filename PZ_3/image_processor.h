@@ -0,0 +1,3438 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <exception>
+#include <chrono>
+#include <type_traits>
+
+#ifdef _WIN32
+    #define NOMINMAX
+    #include <direct.h>
+    #include <windows.h>
+#else
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define PZ3_HAVE_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define PZ3_HAVE_SSE2 1
+#endif
+
+namespace ImageProcessor {
+    inline bool makeFolder(const std::string& path) {
+    #ifdef _WIN32
+        return _mkdir(path.c_str()) == 0;
+    #else
+        return mkdir(path.c_str(), 0755) == 0;
+    #endif
+    }
+
+    inline std::vector<std::string> findFiles(const std::string& folder, const std::string& ext = "") {
+        std::vector<std::string> file_list;
+        
+    #ifdef _WIN32
+        WIN32_FIND_DATA file_data;
+        HANDLE handle = FindFirstFile((folder + "/*").c_str(), &file_data);
+        
+        if (handle != INVALID_HANDLE_VALUE) {
+            do {
+                std::string name = file_data.cFileName;
+                if (name == "." || name == "..") continue;
+                
+                if (ext.empty() || name.find(ext) != std::string::npos) {
+                    file_list.push_back(folder + "/" + name);
+                }
+            } while (FindNextFile(handle, &file_data) != 0);
+            FindClose(handle);
+        }
+    #else
+        DIR* directory = opendir(folder.c_str());
+        if (directory != nullptr) {
+            struct dirent* entry;
+            while ((entry = readdir(directory)) != nullptr) {
+                std::string name = entry->d_name;
+                if (name == "." || name == "..") continue;
+                
+                if (ext.empty() || name.find(ext) != std::string::npos) {
+                    file_list.push_back(folder + "/" + name);
+                }
+            }
+            closedir(directory);
+        }
+    #endif
+        return file_list;
+    }
+
+    inline bool replaceFile(const std::string& from, const std::string& to) {
+    #ifdef _WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    #else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+    #endif
+    }
+
+    class MappedFile {
+    private:
+        const unsigned char* bytes;
+        size_t length;
+    #ifdef _WIN32
+        HANDLE mapping;
+    #endif
+
+        void close() {
+            if (bytes == nullptr) return;
+        #ifdef _WIN32
+            UnmapViewOfFile(bytes);
+            CloseHandle(mapping);
+            mapping = nullptr;
+        #else
+            munmap(const_cast<unsigned char*>(bytes), length);
+        #endif
+            bytes = nullptr;
+            length = 0;
+        }
+
+    public:
+        MappedFile() : bytes(nullptr), length(0) {
+        #ifdef _WIN32
+            mapping = nullptr;
+        #endif
+        }
+
+        ~MappedFile() { close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& path) {
+            close();
+        #ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                      OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return false;
+            
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+                CloseHandle(file);
+                return false;
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (mapping == nullptr) return false;
+            
+            bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (bytes == nullptr) {
+                CloseHandle(mapping);
+                mapping = nullptr;
+                return false;
+            }
+            length = static_cast<size_t>(size.QuadPart);
+        #else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+            void* address = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (address == MAP_FAILED) return false;
+            
+            madvise(address, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+            bytes = static_cast<const unsigned char*>(address);
+            length = static_cast<size_t>(info.st_size);
+        #endif
+            return true;
+        }
+
+        const unsigned char* data() const { return bytes; }
+        size_t size() const { return length; }
+    };
+
+    inline bool isPGMSpace(unsigned char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline const unsigned char* skipSpaceAndComments(const unsigned char* cursor, const unsigned char* end) {
+        while (cursor < end) {
+            if (*cursor == '#') {
+                while (cursor < end && *cursor != '\n' && *cursor != '\r') ++cursor;
+            } else if (isPGMSpace(*cursor)) {
+                ++cursor;
+            } else {
+                break;
+            }
+        }
+        return cursor;
+    }
+
+    // Locale-free counterpart of std::from_chars for non-negative decimals.
+    // Returns the position after the last digit, or nullptr if there is no
+    // number at cursor or it does not fit in an int.
+    inline const unsigned char* parseDecimal(const unsigned char* cursor, const unsigned char* end, int& value) {
+        const unsigned char* start = cursor;
+        uint64_t result = 0;
+        while (cursor < end && static_cast<unsigned>(*cursor - '0') < 10u) {
+            result = result * 10 + static_cast<unsigned>(*cursor - '0');
+            if (result > static_cast<uint64_t>(INT32_MAX)) return nullptr;
+            ++cursor;
+        }
+        if (cursor == start) return nullptr;
+        value = static_cast<int>(result);
+        return cursor;
+    }
+
+    struct PGMHeader {
+        bool binary;
+        int width, height, maxValue;
+        size_t dataOffset;
+    };
+
+    inline bool parsePGMHeader(const unsigned char* begin, const unsigned char* end, PGMHeader& header) {
+        if (end - begin < 2 || begin[0] != 'P' || (begin[1] != '2' && begin[1] != '5')) return false;
+        header.binary = (begin[1] == '5');
+        
+        const unsigned char* cursor = begin + 2;
+        int* fields[] = { &header.width, &header.height, &header.maxValue };
+        for (int* field : fields) {
+            const unsigned char* number = skipSpaceAndComments(cursor, end);
+            if (number == cursor) return false;
+            cursor = parseDecimal(number, end, *field);
+            if (cursor == nullptr) return false;
+        }
+        
+        if (cursor == end || !isPGMSpace(*cursor)) return false;
+        header.dataOffset = static_cast<size_t>(cursor + 1 - begin);
+        return header.width > 0 && header.height > 0 && header.maxValue > 0 && header.maxValue <= 65535;
+    }
+
+    struct ImageRect {
+        int x, y, width, height;
+    };
+
+    // Non-owning window onto strided pixels, e.g. a rectangle of a
+    // PixelBuffer. Copying a view copies only the pointer and geometry, so
+    // views are cheap to pass around; the pixels must outlive the view.
+    template <typename Pixel>
+    class ImageView {
+    private:
+        Pixel* origin;
+        int width, height, stride;
+
+    public:
+        using PixelType = std::remove_const_t<Pixel>;
+
+        ImageView() : origin(nullptr), width(0), height(0), stride(0) {}
+        ImageView(Pixel* origin, int w, int h, int rowStride) : origin(origin), width(w), height(h), stride(rowStride) {}
+
+        template <typename Other, typename = std::enable_if_t<std::is_same<const Other, Pixel>::value>>
+        ImageView(const ImageView<Other>& other)
+            : origin(other.row(0)), width(other.getWidth()), height(other.getHeight()), stride(other.getStride()) {}
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        int getStride() const { return stride; }
+
+        Pixel* row(int y) const { return origin + static_cast<size_t>(y) * stride; }
+
+        // The part of rect that lies inside this view.
+        ImageView region(const ImageRect& rect) const {
+            int left = std::min(std::max(rect.x, 0), width);
+            int top = std::min(std::max(rect.y, 0), height);
+            int right = std::max(left, std::min(rect.x + std::max(rect.width, 0), width));
+            int bottom = std::max(top, std::min(rect.y + std::max(rect.height, 0), height));
+            return ImageView(row(top) + left, right - left, bottom - top, stride);
+        }
+    };
+
+    // Source view for the filters. Pixel sits in a non-deduced context, so
+    // it is deduced from the destination alone and a mutable view converts.
+    template <typename Pixel>
+    using ConstView = ImageView<const typename std::remove_const<Pixel>::type>;
+
+    template <typename Pixel>
+    class PixelBuffer {
+    private:
+        int width, height, stride;
+        std::vector<Pixel> storage;
+        const Pixel* borrowed;
+        std::shared_ptr<const void> owner;
+
+        const Pixel* base() const { return borrowed ? borrowed : storage.data(); }
+
+        void detach() {
+            std::vector<Pixel> copy(static_cast<size_t>(width) * height);
+            for (int y = 0; y < height; ++y) {
+                const Pixel* line = base() + static_cast<size_t>(y) * stride;
+                std::copy(line, line + width, copy.data() + static_cast<size_t>(y) * width);
+            }
+            storage.swap(copy);
+            stride = width;
+            borrowed = nullptr;
+            owner.reset();
+        }
+
+    public:
+        using PixelType = Pixel;
+
+        PixelBuffer() : width(0), height(0), stride(0), borrowed(nullptr) {}
+
+        void resize(int w, int h) {
+            width = w;
+            height = h;
+            stride = w;
+            borrowed = nullptr;
+            owner.reset();
+            storage.assign(static_cast<size_t>(stride) * height, Pixel(0));
+        }
+
+        // Uses pixels that live elsewhere (e.g. a mapped file) without copying;
+        // keepAlive holds that memory for as long as the buffer refers to it.
+        // The first write access copies the pixels into owned storage.
+        void adopt(const Pixel* pixels, int w, int h, int rowStride, std::shared_ptr<const void> keepAlive) {
+            std::vector<Pixel>().swap(storage);
+            width = w;
+            height = h;
+            stride = rowStride;
+            borrowed = pixels;
+            owner = std::move(keepAlive);
+        }
+
+        void clear() {
+            width = height = stride = 0;
+            borrowed = nullptr;
+            owner.reset();
+            std::vector<Pixel>().swap(storage);
+        }
+
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        int getStride() const { return stride; }
+        bool isBorrowed() const { return borrowed != nullptr; }
+
+        // Copies borrowed pixels into owned storage up front, so that rows
+        // can then be written from several threads at once.
+        void makeWritable() {
+            if (borrowed) detach();
+        }
+
+        Pixel* row(int y) {
+            if (borrowed) detach();
+            return storage.data() + static_cast<size_t>(y) * stride;
+        }
+        const Pixel* row(int y) const { return base() + static_cast<size_t>(y) * stride; }
+
+        ImageView<const Pixel> view() const { return ImageView<const Pixel>(base(), width, height, stride); }
+
+        ImageView<Pixel> writableView() {
+            makeWritable();
+            return ImageView<Pixel>(storage.data(), width, height, stride);
+        }
+    };
+
+    template <typename Pixel>
+    void medianRowSort(const Pixel* const* rows, int window, Pixel* out, int colBegin, int colEnd,
+                       std::vector<Pixel>& values) {
+        int margin = window / 2;
+        values.resize(static_cast<size_t>(window) * window);
+
+        for (int col = colBegin; col < colEnd; ++col) {
+            size_t count = 0;
+            for (int dr = 0; dr < window; ++dr) {
+                const Pixel* line = rows[dr] + (col - margin);
+                for (int dc = 0; dc < window; ++dc) {
+                    values[count++] = line[dc];
+                }
+            }
+            std::sort(values.begin(), values.end());
+            out[col] = values[values.size() / 2];
+        }
+    }
+
+    template <typename Pixel>
+    void medianFilterSort(ConstView<Pixel> src, ImageView<Pixel> dst, int window,
+                          int rowBegin, int rowEnd) {
+        int margin = window / 2;
+        std::vector<Pixel> values;
+        std::vector<const Pixel*> rows(window);
+
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            for (int dr = 0; dr < window; ++dr) {
+                rows[dr] = src.row(row - margin + dr);
+            }
+            medianRowSort(rows.data(), window, dst.row(row), margin, src.getWidth() - margin, values);
+        }
+    }
+
+    template <typename Pixel>
+    class HistogramMedian {
+    private:
+        int width, window, shift, coarseBins, fineBins;
+        std::vector<uint16_t> columnCoarse, columnFine;
+        std::vector<uint32_t> kernelCoarse, kernelFine;
+        std::vector<int> lastUpdated;
+
+        static void addColumn(uint32_t* kernel, const uint16_t* column, int count) {
+            for (int i = 0; i < count; ++i) kernel[i] += column[i];
+        }
+
+        static void subtractColumn(uint32_t* kernel, const uint16_t* column, int count) {
+            for (int i = 0; i < count; ++i) kernel[i] -= column[i];
+        }
+
+        void refreshSegment(int segment, int col) {
+            int margin = window / 2;
+            int size = 1 << shift;
+            uint32_t* kernel = &kernelFine[static_cast<size_t>(segment) << shift];
+            int last = lastUpdated[segment];
+
+            if (col - last >= window) {
+                std::fill(kernel, kernel + size, 0u);
+                for (int c = col - margin; c <= col + margin; ++c) {
+                    addColumn(kernel, fineColumn(c) + (segment << shift), size);
+                }
+            } else {
+                for (int c = last + 1; c <= col; ++c) {
+                    addColumn(kernel, fineColumn(c + margin) + (segment << shift), size);
+                    subtractColumn(kernel, fineColumn(c - margin - 1) + (segment << shift), size);
+                }
+            }
+            lastUpdated[segment] = col;
+        }
+
+        const uint16_t* fineColumn(int col) const {
+            return &columnFine[static_cast<size_t>(col) * fineBins];
+        }
+
+        const uint16_t* coarseColumn(int col) const {
+            return &columnCoarse[static_cast<size_t>(col) * coarseBins];
+        }
+
+    public:
+        HistogramMedian(int width, int window, int bins)
+            : width(width), window(window), shift(0) {
+            while ((1 << (2 * shift)) < bins) ++shift;
+            coarseBins = (bins + (1 << shift) - 1) >> shift;
+            fineBins = coarseBins << shift;
+            columnCoarse.assign(static_cast<size_t>(width) * coarseBins, 0);
+            columnFine.assign(static_cast<size_t>(width) * fineBins, 0);
+            kernelCoarse.assign(coarseBins, 0);
+            kernelFine.assign(fineBins, 0);
+            lastUpdated.assign(coarseBins, 0);
+        }
+
+        void addRow(const Pixel* line) {
+            for (int x = 0; x < width; ++x) {
+                ++columnFine[static_cast<size_t>(x) * fineBins + line[x]];
+                ++columnCoarse[static_cast<size_t>(x) * coarseBins + (line[x] >> shift)];
+            }
+        }
+
+        void removeRow(const Pixel* line) {
+            for (int x = 0; x < width; ++x) {
+                --columnFine[static_cast<size_t>(x) * fineBins + line[x]];
+                --columnCoarse[static_cast<size_t>(x) * coarseBins + (line[x] >> shift)];
+            }
+        }
+
+        void filterRow(Pixel* out) {
+            int margin = window / 2;
+            uint32_t rank = static_cast<uint32_t>(window) * window / 2;
+            if (width < window) return;
+
+            std::fill(kernelCoarse.begin(), kernelCoarse.end(), 0u);
+            for (int c = 0; c < window - 1; ++c) {
+                addColumn(kernelCoarse.data(), coarseColumn(c), coarseBins);
+            }
+            std::fill(lastUpdated.begin(), lastUpdated.end(), -2 * window);
+
+            for (int col = margin; col < width - margin; ++col) {
+                addColumn(kernelCoarse.data(), coarseColumn(col + margin), coarseBins);
+
+                uint32_t below = 0;
+                int segment = 0;
+                while (below + kernelCoarse[segment] <= rank) {
+                    below += kernelCoarse[segment++];
+                }
+
+                refreshSegment(segment, col);
+                const uint32_t* fine = &kernelFine[static_cast<size_t>(segment) << shift];
+                int value = 0;
+                while (below + fine[value] <= rank) {
+                    below += fine[value++];
+                }
+                out[col] = static_cast<Pixel>((segment << shift) + value);
+
+                subtractColumn(kernelCoarse.data(), coarseColumn(col - margin), coarseBins);
+            }
+        }
+    };
+
+    template <typename Pixel>
+    void medianFilterHistogram(ConstView<Pixel> src, ImageView<Pixel> dst, int window,
+                               int rowBegin, int rowEnd, int bins) {
+        int margin = window / 2;
+        if (src.getWidth() < window) return;
+
+        HistogramMedian<Pixel> histogram(src.getWidth(), window, bins);
+        for (int row = rowBegin - margin; row < rowBegin + margin; ++row) {
+            histogram.addRow(src.row(row));
+        }
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            histogram.addRow(src.row(row + margin));
+            histogram.filterRow(dst.row(row));
+            histogram.removeRow(src.row(row - margin));
+        }
+    }
+
+    template <typename Lane>
+    inline void sortPair(Lane& a, Lane& b) {
+        Lane low = std::min(a, b);
+        b = std::max(a, b);
+        a = low;
+    }
+
+#ifdef PZ3_HAVE_SSE2
+    inline void sortPair(__m128i& a, __m128i& b) {
+        __m128i low = _mm_min_epu8(a, b);
+        b = _mm_max_epu8(a, b);
+        a = low;
+    }
+#endif
+
+#ifdef PZ3_HAVE_AVX2
+    inline void sortPair(__m256i& a, __m256i& b) {
+        __m256i low = _mm256_min_epu8(a, b);
+        b = _mm256_max_epu8(a, b);
+        a = low;
+    }
+#endif
+
+#ifdef PZ3_HAVE_SSE2
+    // SSE2 only compares signed 16-bit lanes, so 16-bit samples are held
+    // with the top bit flipped, which maps unsigned order onto signed order.
+    struct SignedWords {
+        __m128i value;
+    };
+
+    inline void sortPair(SignedWords& a, SignedWords& b) {
+        __m128i low = _mm_min_epi16(a.value, b.value);
+        b.value = _mm_max_epi16(a.value, b.value);
+        a.value = low;
+    }
+#endif
+
+#ifdef PZ3_HAVE_AVX2
+    struct Words256 {
+        __m256i value;
+    };
+
+    inline void sortPair(Words256& a, Words256& b) {
+        __m256i low = _mm256_min_epu16(a.value, b.value);
+        b.value = _mm256_max_epu16(a.value, b.value);
+        a.value = low;
+    }
+#endif
+
+    // Exchange networks from Devillard's "Fast median search"; the same
+    // sequence runs on scalars and on SIMD registers, so every lane width
+    // produces identical output.
+    template <typename Lane>
+    Lane medianOf9(Lane* p) {
+        sortPair(p[1], p[2]);   sortPair(p[4], p[5]);   sortPair(p[7], p[8]);
+        sortPair(p[0], p[1]);   sortPair(p[3], p[4]);   sortPair(p[6], p[7]);
+        sortPair(p[1], p[2]);   sortPair(p[4], p[5]);   sortPair(p[7], p[8]);
+        sortPair(p[0], p[3]);   sortPair(p[5], p[8]);   sortPair(p[4], p[7]);
+        sortPair(p[3], p[6]);   sortPair(p[1], p[4]);   sortPair(p[2], p[5]);
+        sortPair(p[4], p[7]);   sortPair(p[4], p[2]);   sortPair(p[6], p[4]);
+        sortPair(p[4], p[2]);
+        return p[4];
+    }
+
+    template <typename Lane>
+    Lane medianOf25(Lane* p) {
+        sortPair(p[0], p[1]);   sortPair(p[3], p[4]);   sortPair(p[2], p[4]);
+        sortPair(p[2], p[3]);   sortPair(p[6], p[7]);   sortPair(p[5], p[7]);
+        sortPair(p[5], p[6]);   sortPair(p[9], p[10]);  sortPair(p[8], p[10]);
+        sortPair(p[8], p[9]);   sortPair(p[12], p[13]); sortPair(p[11], p[13]);
+        sortPair(p[11], p[12]); sortPair(p[15], p[16]); sortPair(p[14], p[16]);
+        sortPair(p[14], p[15]); sortPair(p[18], p[19]); sortPair(p[17], p[19]);
+        sortPair(p[17], p[18]); sortPair(p[21], p[22]); sortPair(p[20], p[22]);
+        sortPair(p[20], p[21]); sortPair(p[23], p[24]); sortPair(p[2], p[5]);
+        sortPair(p[3], p[6]);   sortPair(p[0], p[6]);   sortPair(p[0], p[3]);
+        sortPair(p[4], p[7]);   sortPair(p[1], p[7]);   sortPair(p[1], p[4]);
+        sortPair(p[11], p[14]); sortPair(p[8], p[14]);  sortPair(p[8], p[11]);
+        sortPair(p[12], p[15]); sortPair(p[9], p[15]);  sortPair(p[9], p[12]);
+        sortPair(p[13], p[16]); sortPair(p[10], p[16]); sortPair(p[10], p[13]);
+        sortPair(p[20], p[23]); sortPair(p[17], p[23]); sortPair(p[17], p[20]);
+        sortPair(p[21], p[24]); sortPair(p[18], p[24]); sortPair(p[18], p[21]);
+        sortPair(p[19], p[22]); sortPair(p[8], p[17]);  sortPair(p[9], p[18]);
+        sortPair(p[0], p[18]);  sortPair(p[0], p[9]);   sortPair(p[10], p[19]);
+        sortPair(p[1], p[19]);  sortPair(p[1], p[10]);  sortPair(p[11], p[20]);
+        sortPair(p[2], p[20]);  sortPair(p[2], p[11]);  sortPair(p[12], p[21]);
+        sortPair(p[3], p[21]);  sortPair(p[3], p[12]);  sortPair(p[13], p[22]);
+        sortPair(p[4], p[22]);  sortPair(p[4], p[13]);  sortPair(p[14], p[23]);
+        sortPair(p[5], p[23]);  sortPair(p[5], p[14]);  sortPair(p[15], p[24]);
+        sortPair(p[6], p[24]);  sortPair(p[6], p[15]);  sortPair(p[7], p[16]);
+        sortPair(p[7], p[19]);  sortPair(p[13], p[21]); sortPair(p[15], p[23]);
+        sortPair(p[7], p[13]);  sortPair(p[7], p[15]);  sortPair(p[1], p[9]);
+        sortPair(p[3], p[11]);  sortPair(p[5], p[17]);  sortPair(p[11], p[17]);
+        sortPair(p[9], p[17]);  sortPair(p[4], p[10]);  sortPair(p[6], p[12]);
+        sortPair(p[7], p[14]);  sortPair(p[4], p[6]);   sortPair(p[4], p[7]);
+        sortPair(p[12], p[14]); sortPair(p[10], p[14]); sortPair(p[6], p[7]);
+        sortPair(p[10], p[12]); sortPair(p[6], p[10]);  sortPair(p[6], p[17]);
+        sortPair(p[12], p[17]); sortPair(p[7], p[17]);  sortPair(p[7], p[10]);
+        sortPair(p[12], p[18]); sortPair(p[7], p[12]);  sortPair(p[10], p[18]);
+        sortPair(p[12], p[20]); sortPair(p[10], p[20]); sortPair(p[10], p[12]);
+        return p[12];
+    }
+
+    template <int Window, typename Lane>
+    Lane medianOfWindow(Lane* p) {
+        return (Window == 3) ? medianOf9(p) : medianOf25(p);
+    }
+
+    struct ScalarLanes {
+        static const int width = 1;
+        template <typename Pixel>
+        static Pixel load(const Pixel* source) { return *source; }
+        template <typename Pixel>
+        static void store(Pixel* target, Pixel value) { *target = value; }
+    };
+
+#ifdef PZ3_HAVE_SSE2
+    struct SSE2Lanes {
+        static const int width = 16;
+        static __m128i load(const uint8_t* source) {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+        }
+        static void store(uint8_t* target, __m128i value) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), value);
+        }
+    };
+
+    struct SSE2WordLanes {
+        static const int width = 8;
+        static SignedWords load(const uint16_t* source) {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+            return SignedWords{ _mm_xor_si128(value, _mm_set1_epi16(-0x8000)) };
+        }
+        static void store(uint16_t* target, SignedWords value) {
+            __m128i restored = _mm_xor_si128(value.value, _mm_set1_epi16(-0x8000));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), restored);
+        }
+    };
+#endif
+
+#ifdef PZ3_HAVE_AVX2
+    struct AVX2Lanes {
+        static const int width = 32;
+        static __m256i load(const uint8_t* source) {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        }
+        static void store(uint8_t* target, __m256i value) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), value);
+        }
+    };
+
+    struct AVX2WordLanes {
+        static const int width = 16;
+        static Words256 load(const uint16_t* source) {
+            return Words256{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)) };
+        }
+        static void store(uint16_t* target, Words256 value) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), value.value);
+        }
+    };
+#endif
+
+    template <int Window, typename Lanes, typename Pixel>
+    int medianRowNetworkPass(const Pixel* const* rows, Pixel* out, int col, int colEnd) {
+        const int margin = Window / 2;
+        using Lane = decltype(Lanes::load(rows[0]));
+        Lane p[Window * Window];
+
+        for (; col + Lanes::width <= colEnd; col += Lanes::width) {
+            for (int dr = 0; dr < Window; ++dr) {
+                const Pixel* line = rows[dr] + (col - margin);
+                for (int dc = 0; dc < Window; ++dc) {
+                    p[dr * Window + dc] = Lanes::load(line + dc);
+                }
+            }
+            Lanes::store(out + col, medianOfWindow<Window>(p));
+        }
+        return col;
+    }
+
+    template <int Window, typename Pixel>
+    void medianRowNetwork(const Pixel* const* rows, Pixel* out, int colBegin, int colEnd) {
+        medianRowNetworkPass<Window, ScalarLanes>(rows, out, colBegin, colEnd);
+    }
+
+    template <int Window>
+    void medianRowNetwork(const uint8_t* const* rows, uint8_t* out, int colBegin, int colEnd) {
+        int col = colBegin;
+#ifdef PZ3_HAVE_AVX2
+        col = medianRowNetworkPass<Window, AVX2Lanes>(rows, out, col, colEnd);
+#endif
+#ifdef PZ3_HAVE_SSE2
+        col = medianRowNetworkPass<Window, SSE2Lanes>(rows, out, col, colEnd);
+#endif
+        medianRowNetworkPass<Window, ScalarLanes>(rows, out, col, colEnd);
+    }
+
+    template <int Window>
+    void medianRowNetwork(const uint16_t* const* rows, uint16_t* out, int colBegin, int colEnd) {
+        int col = colBegin;
+#ifdef PZ3_HAVE_AVX2
+        col = medianRowNetworkPass<Window, AVX2WordLanes>(rows, out, col, colEnd);
+#endif
+#ifdef PZ3_HAVE_SSE2
+        col = medianRowNetworkPass<Window, SSE2WordLanes>(rows, out, col, colEnd);
+#endif
+        medianRowNetworkPass<Window, ScalarLanes>(rows, out, col, colEnd);
+    }
+
+    inline bool hasMedianNetwork(int window) {
+        return window == 3 || window == 5;
+    }
+
+    template <typename Pixel>
+    void medianNetworkRow(const Pixel* const* rows, int window, Pixel* out, int colBegin, int colEnd) {
+        if (window == 3) {
+            medianRowNetwork<3>(rows, out, colBegin, colEnd);
+        } else {
+            medianRowNetwork<5>(rows, out, colBegin, colEnd);
+        }
+    }
+
+    template <typename Pixel>
+    void medianFilterNetwork(ConstView<Pixel> src, ImageView<Pixel> dst, int window,
+                             int rowBegin, int rowEnd) {
+        int margin = window / 2;
+        const Pixel* rows[5];
+
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            for (int dr = 0; dr < window; ++dr) {
+                rows[dr] = src.row(row - margin + dr);
+            }
+            medianNetworkRow(rows, window, dst.row(row), margin, src.getWidth() - margin);
+        }
+    }
+
+    enum class MedianEngine { Auto, Sort, Histogram, Network };
+
+    // Column histograms take width * bins counters, which stays affordable
+    // up to 12-bit samples; wider data falls back to sorting.
+    const int kMaxHistogramBins = 4096;
+
+    // Bins covering every sample in [0, maxValue], or 0 when there would be
+    // too many. 16-bit samples are clamped to maxValue when they are read.
+    template <typename Pixel>
+    int histogramBins(int maxValue) {
+        int bins = (sizeof(Pixel) == 1) ? 256 : maxValue + 1;
+        return (bins <= kMaxHistogramBins) ? bins : 0;
+    }
+
+    template <typename Pixel>
+    MedianEngine resolveMedianEngine(MedianEngine engine, int window, int maxValue) {
+        if (engine == MedianEngine::Network && !hasMedianNetwork(window)) {
+            engine = MedianEngine::Auto;
+        }
+        if (engine == MedianEngine::Histogram && histogramBins<Pixel>(maxValue) == 0) {
+            engine = MedianEngine::Sort;
+        }
+        if (engine == MedianEngine::Auto) {
+            if (hasMedianNetwork(window)) {
+                engine = MedianEngine::Network;
+            } else {
+                engine = (histogramBins<Pixel>(maxValue) > 0) ? MedianEngine::Histogram : MedianEngine::Sort;
+            }
+        }
+        return engine;
+    }
+
+    template <typename Pixel>
+    void medianFilterRows(ConstView<Pixel> src, ImageView<Pixel> dst, int window,
+                          MedianEngine engine, int maxValue, int rowBegin, int rowEnd) {
+        int margin = window / 2;
+        rowBegin = std::max(rowBegin, margin);
+        rowEnd = std::min(rowEnd, src.getHeight() - margin);
+        if (rowBegin >= rowEnd) return;
+
+        switch (resolveMedianEngine<Pixel>(engine, window, maxValue)) {
+        case MedianEngine::Network:
+            medianFilterNetwork(src, dst, window, rowBegin, rowEnd);
+            break;
+        case MedianEngine::Histogram:
+            medianFilterHistogram(src, dst, window, rowBegin, rowEnd, histogramBins<Pixel>(maxValue));
+            break;
+        default:
+            medianFilterSort(src, dst, window, rowBegin, rowEnd);
+            break;
+        }
+    }
+
+    // The view overloads are the public entry points: a window that is not
+    // a positive odd size leaves dst untouched, as PGMHandler does.
+    template <typename Pixel>
+    void medianFilter(ConstView<Pixel> src, ImageView<Pixel> dst, int window, MedianEngine engine, int maxValue) {
+        if (window <= 0 || window % 2 == 0) return;
+        medianFilterRows(src, dst, window, engine, maxValue, 0, src.getHeight());
+    }
+
+    template <typename Pixel>
+    void medianFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, int window, MedianEngine engine,
+                      int maxValue) {
+        medianFilter(src.view(), dst.writableView(), window, engine, maxValue);
+    }
+
+    class WorkerPool {
+    private:
+        std::vector<std::thread> workers;
+        std::mutex submitLock, lock;
+        std::condition_variable wake, finished;
+        std::function<void(int)> job;
+        std::exception_ptr failure;
+        int jobCount, nextIndex, pending;
+        unsigned generation;
+        bool stopping;
+
+        void drain(std::unique_lock<std::mutex>& guard) {
+            while (nextIndex < jobCount) {
+                int index = nextIndex++;
+                guard.unlock();
+                std::exception_ptr error;
+                try {
+                    job(index);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                guard.lock();
+                if (error && !failure) failure = error;
+                if (--pending == 0) finished.notify_all();
+            }
+        }
+
+        void workerLoop() {
+            unsigned seen = 0;
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+                drain(guard);
+            }
+        }
+
+    public:
+        explicit WorkerPool(int threads = 0)
+            : jobCount(0), nextIndex(0), pending(0), generation(0), stopping(false) {
+            if (threads <= 0) {
+                threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+            }
+            for (int i = 1; i < threads; ++i) {
+                workers.emplace_back(&WorkerPool::workerLoop, this);
+            }
+        }
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        int size() const { return static_cast<int>(workers.size()) + 1; }
+
+        // Runs body(0) .. body(count - 1) on the workers and the calling
+        // thread, returning once every index has finished; rethrows the
+        // first failure.
+        void parallelFor(int count, const std::function<void(int)>& body) {
+            if (count <= 0) return;
+            std::lock_guard<std::mutex> submitted(submitLock);
+            std::unique_lock<std::mutex> guard(lock);
+            job = body;
+            jobCount = count;
+            nextIndex = 0;
+            pending = count;
+            ++generation;
+            wake.notify_all();
+            drain(guard);
+            finished.wait(guard, [&] { return pending == 0; });
+            job = nullptr;
+            if (failure) {
+                std::exception_ptr error = failure;
+                failure = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+    };
+
+    const size_t kTileBytes = 256 * 1024;
+
+    template <typename Pixel>
+    int tileRows(ImageView<const Pixel> src, int window, const WorkerPool& pool) {
+        int height = src.getHeight();
+        size_t rowBytes = std::max<size_t>(1, static_cast<size_t>(src.getWidth()) * sizeof(Pixel));
+        int band = static_cast<int>(std::max<size_t>(1, kTileBytes / rowBytes));
+        band = std::max(band, 4 * window);
+        band = std::min(band, (height + pool.size() - 1) / pool.size());
+        return std::max(band, 1);
+    }
+
+    template <typename Pixel>
+    void medianFilter(ConstView<Pixel> src, ImageView<Pixel> dst, int window, MedianEngine engine, int maxValue,
+                      WorkerPool& pool) {
+        if (window <= 0 || window % 2 == 0) return;
+        int height = src.getHeight();
+        int band = tileRows(src, window, pool);
+        int tiles = (height + band - 1) / band;
+        pool.parallelFor(tiles, [&](int tile) {
+            medianFilterRows(src, dst, window, engine, maxValue, tile * band, std::min(height, (tile + 1) * band));
+        });
+    }
+
+    template <typename Pixel>
+    void medianFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, int window, MedianEngine engine,
+                      int maxValue, WorkerPool& pool) {
+        medianFilter(src.view(), dst.writableView(), window, engine, maxValue, pool);
+    }
+
+    template <typename Pixel>
+    int nextImpulse(const Pixel* line, int col, int width, Pixel high) {
+        while (col < width && line[col] != 0 && line[col] != high) ++col;
+        return col;
+    }
+
+#ifdef PZ3_HAVE_SSE2
+    inline int nextImpulse(const uint8_t* line, int col, int width, uint8_t high) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i peak = _mm_set1_epi8(static_cast<char>(high));
+        for (; col + 16 <= width; col += 16) {
+            __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + col));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(values, zero), _mm_cmpeq_epi8(values, peak)));
+            if (mask != 0) {
+                int offset = 0;
+                while (!(mask & (1 << offset))) ++offset;
+                return col + offset;
+            }
+        }
+        return nextImpulse<uint8_t>(line, col, width, high);
+    }
+
+    inline int nextImpulse(const uint16_t* line, int col, int width, uint16_t high) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i peak = _mm_set1_epi16(static_cast<short>(high));
+        for (; col + 8 <= width; col += 8) {
+            __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + col));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(values, zero), _mm_cmpeq_epi16(values, peak)));
+            if (mask != 0) {
+                int offset = 0;
+                while (!(mask & (1 << offset))) ++offset;
+                return col + offset / 2;
+            }
+        }
+        return nextImpulse<uint16_t>(line, col, width, high);
+    }
+#endif
+
+    // Switching median for salt-and-pepper noise: only pixels equal to 0 or
+    // high are treated as impulses and replaced, by the median of the
+    // non-impulse pixels in the smallest window (3, 5, .. maxWindow) that has
+    // any, clipped at the image border. Every other pixel is left as is.
+    template <typename Pixel>
+    void adaptiveMedianRows(ConstView<Pixel> src, ImageView<Pixel> dst, int maxWindow, Pixel high,
+                            int rowBegin, int rowEnd) {
+        int width = src.getWidth();
+        int height = src.getHeight();
+        int span = 2 * (maxWindow / 2) + 1;
+        std::vector<Pixel> values(static_cast<size_t>(span) * span);
+
+        for (int row = rowBegin; row < rowEnd; ++row) {
+            const Pixel* line = src.row(row);
+            Pixel* out = dst.row(row);
+            for (int col = nextImpulse(line, 0, width, high); col < width; col = nextImpulse(line, col + 1, width, high)) {
+                for (int radius = 1; radius <= maxWindow / 2; ++radius) {
+                    int top = std::max(0, row - radius), bottom = std::min(height - 1, row + radius);
+                    int left = std::max(0, col - radius), right = std::min(width - 1, col + radius);
+                    size_t count = 0;
+                    for (int y = top; y <= bottom; ++y) {
+                        const Pixel* neighbours = src.row(y);
+                        for (int x = left; x <= right; ++x) {
+                            values[count] = neighbours[x];
+                            count += (neighbours[x] != 0 && neighbours[x] != high);
+                        }
+                    }
+                    if (count == 0 && radius == maxWindow / 2) {
+                        for (int y = top; y <= bottom; ++y) {
+                            for (int x = left; x <= right; ++x) values[count++] = src.row(y)[x];
+                        }
+                    }
+                    if (count == 0) continue;
+
+                    // Windows of a few pixels are the common case at low
+                    // noise levels, where an insertion sort beats nth_element.
+                    if (count <= 16) {
+                        for (size_t i = 1; i < count; ++i) {
+                            Pixel value = values[i];
+                            size_t j = i;
+                            for (; j > 0 && values[j - 1] > value; --j) values[j] = values[j - 1];
+                            values[j] = value;
+                        }
+                    } else {
+                        std::nth_element(values.begin(), values.begin() + count / 2, values.begin() + count);
+                    }
+                    out[col] = values[count / 2];
+                    break;
+                }
+            }
+        }
+    }
+
+    template <typename Pixel>
+    void adaptiveMedianFilter(ConstView<Pixel> src, ImageView<Pixel> dst, int maxWindow, Pixel high) {
+        if (maxWindow < 3 || maxWindow % 2 == 0) return;
+        adaptiveMedianRows(src, dst, maxWindow, high, 0, src.getHeight());
+    }
+
+    template <typename Pixel>
+    void adaptiveMedianFilter(ConstView<Pixel> src, ImageView<Pixel> dst, int maxWindow, Pixel high,
+                              WorkerPool& pool) {
+        if (maxWindow < 3 || maxWindow % 2 == 0) return;
+        int height = src.getHeight();
+        int band = tileRows(src, maxWindow, pool);
+        int tiles = (height + band - 1) / band;
+        pool.parallelFor(tiles, [&](int tile) {
+            adaptiveMedianRows(src, dst, maxWindow, high, tile * band, std::min(height, (tile + 1) * band));
+        });
+    }
+
+    template <typename Pixel>
+    void adaptiveMedianFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, int maxWindow, Pixel high) {
+        adaptiveMedianFilter(src.view(), dst.writableView(), maxWindow, high);
+    }
+
+    template <typename Pixel>
+    void adaptiveMedianFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, int maxWindow, Pixel high,
+                              WorkerPool& pool) {
+        adaptiveMedianFilter(src.view(), dst.writableView(), maxWindow, high, pool);
+    }
+
+    // Sums of in[x - radius .. x + radius] for every x, edges replicated,
+    // kept as running sums so the cost does not depend on the radius.
+    template <typename In>
+    void boxRowSums(const In* in, int width, int radius, float* out) {
+        // Integer pixels keep an exact integer sum, which also keeps the
+        // running-sum dependency chain at one cycle per pixel.
+        using Sum = std::conditional_t<std::is_integral<In>::value, int64_t, double>;
+        Sum sum = static_cast<Sum>(in[0]) * (radius + 1);
+        for (int k = 1; k <= radius; ++k) sum += in[std::min(k, width - 1)];
+
+        // Only the first and last radius + 1 columns need clamped indices.
+        int interiorBegin = std::min(radius, width);
+        int interiorEnd = std::max(interiorBegin, width - radius - 1);
+        int x = 0;
+        for (; x < interiorBegin; ++x) {
+            out[x] = static_cast<float>(sum);
+            sum += static_cast<Sum>(in[std::min(x + radius + 1, width - 1)]) - in[0];
+        }
+        for (; x < interiorEnd; ++x) {
+            out[x] = static_cast<float>(sum);
+            sum += static_cast<Sum>(in[x + radius + 1]) - in[x - radius];
+        }
+        for (; x < width; ++x) {
+            out[x] = static_cast<float>(sum);
+            sum += static_cast<Sum>(in[width - 1]) - in[std::max(x - radius, 0)];
+        }
+    }
+
+    inline void addRowDifference(double* column, const float* added, const float* removed, int width) {
+        int x = 0;
+    #ifdef PZ3_HAVE_SSE2
+        for (; x + 4 <= width; x += 4) {
+            __m128 difference = _mm_sub_ps(_mm_loadu_ps(added + x), _mm_loadu_ps(removed + x));
+            __m128d low = _mm_add_pd(_mm_loadu_pd(column + x), _mm_cvtps_pd(difference));
+            __m128d high = _mm_add_pd(_mm_loadu_pd(column + x + 2), _mm_cvtps_pd(_mm_movehl_ps(difference, difference)));
+            _mm_storeu_pd(column + x, low);
+            _mm_storeu_pd(column + x + 2, high);
+        }
+    #endif
+        for (; x < width; ++x) column[x] += static_cast<double>(added[x]) - removed[x];
+    }
+
+    template <typename In>
+    void multiplyAddRow(float* out, const In* in, float weight, int count) {
+        for (int x = 0; x < count; ++x) out[x] += weight * in[x];
+    }
+
+#ifdef PZ3_HAVE_SSE2
+    inline void multiplyAddRow(float* out, const float* in, float weight, int count) {
+        const __m128 factor = _mm_set1_ps(weight);
+        int x = 0;
+        for (; x + 4 <= count; x += 4) {
+            __m128 sum = _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(factor, _mm_loadu_ps(in + x)));
+            _mm_storeu_ps(out + x, sum);
+        }
+        for (; x < count; ++x) out[x] += weight * in[x];
+    }
+
+    inline void multiplyAddRow(float* out, const uint8_t* in, float weight, int count) {
+        const __m128 factor = _mm_set1_ps(weight);
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+            __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + x));
+            __m128i words = _mm_unpacklo_epi8(bytes, zero);
+            __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+            __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+            _mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(factor, low)));
+            _mm_storeu_ps(out + x + 4, _mm_add_ps(_mm_loadu_ps(out + x + 4), _mm_mul_ps(factor, high)));
+        }
+        for (; x < count; ++x) out[x] += weight * in[x];
+    }
+
+    inline void multiplyAddRow(float* out, const uint16_t* in, float weight, int count) {
+        const __m128 factor = _mm_set1_ps(weight);
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (; x + 8 <= count; x += 8) {
+            __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+            __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+            __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero));
+            _mm_storeu_ps(out + x, _mm_add_ps(_mm_loadu_ps(out + x), _mm_mul_ps(factor, low)));
+            _mm_storeu_ps(out + x + 4, _mm_add_ps(_mm_loadu_ps(out + x + 4), _mm_mul_ps(factor, high)));
+        }
+        for (; x < count; ++x) out[x] += weight * in[x];
+    }
+#endif
+
+    inline void storeSample(double value, float& out) { out = static_cast<float>(value); }
+    inline void storeSample(double value, uint8_t& out) { out = static_cast<uint8_t>(value + 0.5); }
+    inline void storeSample(double value, uint16_t& out) { out = static_cast<uint16_t>(value + 0.5); }
+
+    // One pass of a (2 * radius + 1)^2 mean filter. Row sums are taken once
+    // per input row into a ring of 2 * radius + 2 rows, and the vertical
+    // pass keeps one running sum per column, so both passes walk whole rows
+    // and the column update vectorizes along them. Every input row is read
+    // before the output row with the same index is written, so srcRow and
+    // dstRow may refer to the same rows.
+    template <typename SrcRow, typename DstRow>
+    void boxPass(SrcRow srcRow, DstRow dstRow, int width, int height, int radius) {
+        int ringRows = 2 * radius + 2;
+        double scale = 1.0 / ((2.0 * radius + 1) * (2.0 * radius + 1));
+        std::vector<float> ring(static_cast<size_t>(ringRows) * width);
+        std::vector<double> column(width, 0.0);
+        int computed = 0;
+
+        auto rowSums = [&](int y) {
+            for (; computed <= y; ++computed) {
+                boxRowSums(srcRow(computed), width, radius, ring.data() + static_cast<size_t>(computed % ringRows) * width);
+            }
+            return static_cast<const float*>(ring.data() + static_cast<size_t>(y % ringRows) * width);
+        };
+
+        for (int k = -radius; k <= radius; ++k) {
+            const float* sums = rowSums(std::min(std::max(k, 0), height - 1));
+            for (int x = 0; x < width; ++x) column[x] += sums[x];
+        }
+        for (int y = 0; y < height; ++y) {
+            auto* out = dstRow(y);
+            for (int x = 0; x < width; ++x) storeSample(column[x] * scale, out[x]);
+            if (y + 1 == height) break;
+
+            const float* removed = rowSums(std::max(y - radius, 0));
+            const float* added = rowSums(std::min(y + radius + 1, height - 1));
+            addRowDifference(column.data(), added, removed, width);
+        }
+    }
+
+    template <typename Pixel>
+    void boxFilter(ConstView<Pixel> src, ImageView<Pixel> dst, int radius) {
+        if (radius < 0) return;
+        boxPass([&](int y) { return src.row(y); }, [&](int y) { return dst.row(y); },
+                src.getWidth(), src.getHeight(), radius);
+    }
+
+    template <typename Pixel>
+    void boxFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, int radius) {
+        boxFilter(src.view(), dst.writableView(), radius);
+    }
+
+    // Radii of three box passes whose combined variance is closest to
+    // sigma^2 (Kovesi's construction with odd widths wl and wl + 2).
+    inline std::vector<int> gaussianBoxRadii(double sigma, int passes = 3) {
+        double idealWidth = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+        int lower = static_cast<int>(std::floor(idealWidth));
+        if (lower % 2 == 0) --lower;
+        lower = std::max(lower, 1);
+        double idealCount = (12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) /
+                            (-4.0 * lower - 4.0);
+        int lowerCount = static_cast<int>(std::lround(idealCount));
+
+        std::vector<int> radii;
+        for (int i = 0; i < passes; ++i) {
+            int boxWidth = (i < lowerCount) ? lower : lower + 2;
+            radii.push_back((boxWidth - 1) / 2);
+        }
+        return radii;
+    }
+
+    // Direct separable convolution with a sampled Gaussian, for sigmas too
+    // small for box passes: every box wider than one pixel already has a
+    // variance of at least 2/3.
+    template <typename Pixel>
+    void gaussianKernelFilter(ConstView<Pixel> src, ImageView<Pixel> dst, double sigma) {
+        int width = src.getWidth();
+        int height = src.getHeight();
+        int radius = std::max(1, static_cast<int>(std::ceil(3.0 * sigma)));
+        std::vector<float> kernel(2 * radius + 1);
+        double total = 0.0;
+        for (int k = -radius; k <= radius; ++k) total += std::exp(-0.5 * k * k / (sigma * sigma));
+        for (int k = -radius; k <= radius; ++k) {
+            kernel[k + radius] = static_cast<float>(std::exp(-0.5 * k * k / (sigma * sigma)) / total);
+        }
+
+        std::vector<float> plane(static_cast<size_t>(width) * height);
+        for (int y = 0; y < height; ++y) {
+            const Pixel* in = src.row(y);
+            float* out = plane.data() + static_cast<size_t>(y) * width;
+            int interiorBegin = std::min(radius, width);
+            int interiorEnd = std::max(interiorBegin, width - radius);
+            std::fill(out, out + width, 0.0f);
+            for (int k = -radius; k <= radius; ++k) {
+                multiplyAddRow(out + interiorBegin, in + interiorBegin + k, kernel[k + radius], interiorEnd - interiorBegin);
+            }
+            for (int x = 0; x < width; ++x) {
+                if (x == interiorBegin) x = interiorEnd;
+                if (x >= width) break;
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += kernel[k + radius] * in[std::min(std::max(x + k, 0), width - 1)];
+                }
+                out[x] = sum;
+            }
+        }
+
+        std::vector<float> column(width);
+        for (int y = 0; y < height; ++y) {
+            std::fill(column.begin(), column.end(), 0.0f);
+            for (int k = -radius; k <= radius; ++k) {
+                const float* in = plane.data() + static_cast<size_t>(std::min(std::max(y + k, 0), height - 1)) * width;
+                multiplyAddRow(column.data(), in, kernel[k + radius], width);
+            }
+            Pixel* out = dst.row(y);
+            for (int x = 0; x < width; ++x) storeSample(column[x], out[x]);
+        }
+    }
+
+    // Below this sigma gaussianFilter convolves directly. Three odd-width
+    // boxes match a small Gaussian's variance only coarsely, and the kernel
+    // has at most 13 taps there, which is about as cheap as three box
+    // passes; above it the kernel grows with sigma and the boxes do not.
+    // bench times both paths from kMinBoxSigma up.
+    const double kMinBoxSigma = 2.0;
+
+    // Gaussian smoothing approximated by repeated box passes; intermediate
+    // passes run in place on one float plane.
+    template <typename Pixel>
+    void gaussianFilter(ConstView<Pixel> src, ImageView<Pixel> dst, double sigma) {
+        if (!(sigma > 0.0)) return;
+        if (sigma < kMinBoxSigma) {
+            gaussianKernelFilter(src, dst, sigma);
+            return;
+        }
+        int width = src.getWidth();
+        int height = src.getHeight();
+        std::vector<int> radii = gaussianBoxRadii(sigma);
+        radii.erase(std::remove(radii.begin(), radii.end(), 0), radii.end());
+        auto srcRow = [&](int y) { return src.row(y); };
+        auto dstRow = [&](int y) { return dst.row(y); };
+
+        if (radii.empty()) {
+            for (int y = 0; y < height; ++y) std::copy(src.row(y), src.row(y) + width, dst.row(y));
+            return;
+        }
+        if (radii.size() == 1) {
+            boxPass(srcRow, dstRow, width, height, radii[0]);
+            return;
+        }
+
+        std::vector<float> plane(static_cast<size_t>(width) * height);
+        auto planeRow = [&](int y) { return plane.data() + static_cast<size_t>(y) * width; };
+        auto planeInput = [&](int y) { return static_cast<const float*>(planeRow(y)); };
+        boxPass(srcRow, planeRow, width, height, radii[0]);
+        for (size_t pass = 1; pass + 1 < radii.size(); ++pass) {
+            boxPass(planeInput, planeRow, width, height, radii[pass]);
+        }
+        boxPass(planeInput, dstRow, width, height, radii.back());
+    }
+
+    template <typename Pixel>
+    void gaussianFilter(const PixelBuffer<Pixel>& src, PixelBuffer<Pixel>& dst, double sigma) {
+        gaussianFilter(src.view(), dst.writableView(), sigma);
+    }
+
+    // The sigma whose +-3 sigma support roughly fills a window of the given
+    // size, as OpenCV derives it for a kernel size.
+    inline double gaussianSigma(int window) {
+        return 0.3 * ((window - 1) * 0.5 - 1.0) + 0.8;
+    }
+
+    enum class PGMFormat { Plain, Binary };
+
+    const size_t kWriteChunk = 1 << 20;
+
+    inline char* formatDecimal(char* out, unsigned value) {
+        char digits[10];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (count > 0) *out++ = digits[--count];
+        return out;
+    }
+
+    const size_t kReadChunk = 1 << 20;
+    const size_t kMaxHeaderBytes = 1 << 16;
+
+    // Reads a PGM file front to back one row at a time, holding only a
+    // read buffer in memory regardless of the image size.
+    class PGMRowReader {
+    private:
+        std::ifstream file;
+        std::vector<unsigned char> buffer;
+        size_t begin, end;
+        bool exhausted, inComment;
+        PGMHeader header;
+
+        bool refill() {
+            if (begin > 0) {
+                std::copy(buffer.begin() + begin, buffer.begin() + end, buffer.begin());
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            file.read(reinterpret_cast<char*>(buffer.data() + end), static_cast<std::streamsize>(buffer.size() - end));
+            size_t received = static_cast<size_t>(file.gcount());
+            end += received;
+            if (received == 0) exhausted = true;
+            return received > 0;
+        }
+
+        bool nextValue(int& value) {
+            while (true) {
+                while (begin < end) {
+                    unsigned char c = buffer[begin];
+                    if (inComment) {
+                        if (c == '\n' || c == '\r') inComment = false;
+                    } else if (c == '#') {
+                        inComment = true;
+                    } else if (!isPGMSpace(c)) {
+                        break;
+                    }
+                    ++begin;
+                }
+                if (begin == end) {
+                    if (!refill()) return false;
+                    continue;
+                }
+                
+                size_t digits = begin;
+                while (digits < end && static_cast<unsigned>(buffer[digits] - '0') < 10u) ++digits;
+                if (digits == end && !exhausted && refill()) continue;
+                
+                const unsigned char* next = parseDecimal(buffer.data() + begin, buffer.data() + end, value);
+                if (next == nullptr) return false;
+                begin = static_cast<size_t>(next - buffer.data());
+                return true;
+            }
+        }
+
+    public:
+        PGMRowReader() : begin(0), end(0), exhausted(false), inComment(false), header() {}
+
+        bool open(const std::string& filename) {
+            file.open(filename, std::ios::binary);
+            if (!file.is_open()) return false;
+            
+            buffer.assign(kReadChunk, 0);
+            begin = end = 0;
+            exhausted = inComment = false;
+            do {
+                if (end >= kMaxHeaderBytes || !refill()) return false;
+            } while (!parsePGMHeader(buffer.data(), buffer.data() + end, header));
+            begin = header.dataOffset;
+            return true;
+        }
+
+        const PGMHeader& getHeader() const { return header; }
+
+        template <typename Pixel>
+        bool readRow(Pixel* out) {
+            int width = header.width;
+            if (!header.binary) {
+                for (int col = 0; col < width; ++col) {
+                    int value;
+                    if (!nextValue(value)) return false;
+                    out[col] = static_cast<Pixel>(std::min(value, header.maxValue));
+                }
+                return true;
+            }
+            
+            size_t sampleBytes = (header.maxValue > 255) ? 2 : 1;
+            size_t rowBytes = static_cast<size_t>(width) * sampleBytes;
+            while (end - begin < rowBytes) {
+                if (!refill()) return false;
+            }
+            const unsigned char* line = buffer.data() + begin;
+            for (int col = 0; col < width; ++col) {
+                out[col] = static_cast<Pixel>((sampleBytes == 2)
+                    ? std::min((line[2 * col] << 8) | line[2 * col + 1], header.maxValue) : line[col]);
+            }
+            begin += rowBytes;
+            return true;
+        }
+    };
+
+    // Writes a PGM file row by row through a large output buffer. The data
+    // goes to a temporary file that replaces the target on close(), so
+    // buffers still viewing a mapped copy of the old file stay valid.
+    class PGMRowWriter {
+    private:
+        std::ofstream file;
+        std::string target, temporary;
+        PGMFormat format;
+        int width;
+        std::vector<char> buffer;
+        size_t used;
+
+        void flush() {
+            file.write(buffer.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+
+        void reserve(size_t bytes) {
+            if (used + bytes > buffer.size()) flush();
+        }
+
+    public:
+        PGMRowWriter() : format(PGMFormat::Plain), width(0), used(0) {}
+
+        ~PGMRowWriter() {
+            if (file.is_open()) {
+                file.close();
+                std::remove(temporary.c_str());
+            }
+        }
+
+        bool open(const std::string& filename, PGMFormat rowFormat, int w, int h, int maxValue) {
+            target = filename;
+            temporary = filename + ".tmp";
+            format = rowFormat;
+            width = w;
+            file.open(temporary, std::ios::binary);
+            if (!file.is_open()) return false;
+            
+            buffer.assign(kWriteChunk + static_cast<size_t>(width) * 6 + 1, 0);
+            used = 0;
+            file << (format == PGMFormat::Binary ? "P5\n" : "P2\n") << w << " " << h << "\n" << maxValue << "\n";
+            return true;
+        }
+
+        void writeRow(const uint8_t* line) {
+            if (format == PGMFormat::Binary) {
+                reserve(width);
+                std::copy(line, line + width, buffer.data() + used);
+                used += width;
+            } else {
+                writePlainRow(line);
+            }
+        }
+
+        void writeRow(const uint16_t* line) {
+            if (format == PGMFormat::Binary) {
+                reserve(static_cast<size_t>(width) * 2);
+                char* out = buffer.data() + used;
+                for (int col = 0; col < width; ++col) {
+                    out[2 * col] = static_cast<char>(line[col] >> 8);
+                    out[2 * col + 1] = static_cast<char>(line[col] & 0xFF);
+                }
+                used += static_cast<size_t>(width) * 2;
+            } else {
+                writePlainRow(line);
+            }
+        }
+
+        template <typename Pixel>
+        void writePlainRow(const Pixel* line) {
+            reserve(static_cast<size_t>(width) * 6 + 1);
+            char* start = buffer.data() + used;
+            char* out = start;
+            for (int col = 0; col < width; ++col) {
+                out = formatDecimal(out, line[col]);
+                *out++ = ' ';
+            }
+            if (width > 0) --out;
+            *out++ = '\n';
+            used += static_cast<size_t>(out - start);
+        }
+
+        template <typename Pixel>
+        void writePixels(const PixelBuffer<Pixel>& pixels) {
+            if (sizeof(Pixel) == 1 && format == PGMFormat::Binary && pixels.getStride() == width) {
+                flush();
+                file.write(reinterpret_cast<const char*>(pixels.row(0)),
+                           static_cast<std::streamsize>(width) * pixels.getHeight());
+                return;
+            }
+            for (int row = 0; row < pixels.getHeight(); ++row) {
+                writeRow(pixels.row(row));
+            }
+        }
+
+        bool close() {
+            flush();
+            file.close();
+            if (!file) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+            return replaceFile(temporary, target);
+        }
+    };
+
+    template <typename Pixel>
+    bool streamMedianRows(PGMRowReader& reader, PGMRowWriter& writer, int window, MedianEngine engine) {
+        int width = reader.getHeader().width;
+        int height = reader.getHeader().height;
+        int margin = window / 2;
+        int maxValue = reader.getHeader().maxValue;
+        engine = resolveMedianEngine<Pixel>(engine, window, maxValue);
+
+        std::vector<Pixel> ring(static_cast<size_t>(width) * window), result(width), values;
+        std::vector<const Pixel*> rows(window);
+        std::unique_ptr<HistogramMedian<Pixel>> histogram;
+        if (engine == MedianEngine::Histogram) {
+            histogram.reset(new HistogramMedian<Pixel>(width, window, histogramBins<Pixel>(maxValue)));
+        }
+        auto slot = [&](int y) { return ring.data() + static_cast<size_t>(y % window) * width; };
+
+        for (int y = 0; y < height; ++y) {
+            Pixel* line = slot(y);
+            if (!reader.readRow(line)) return false;
+            if (y < margin) writer.writeRow(line);
+            if (histogram) histogram->addRow(line);
+            if (y < window - 1) continue;
+
+            int center = y - margin;
+            for (int dr = 0; dr < window; ++dr) {
+                rows[dr] = slot(center - margin + dr);
+            }
+            std::copy(rows[margin], rows[margin] + width, result.begin());
+            if (engine == MedianEngine::Network) {
+                medianNetworkRow(rows.data(), window, result.data(), margin, width - margin);
+            } else if (histogram) {
+                histogram->filterRow(result.data());
+                histogram->removeRow(rows[0]);
+            } else {
+                medianRowSort(rows.data(), window, result.data(), margin, width - margin, values);
+            }
+            writer.writeRow(result.data());
+        }
+
+        for (int y = std::max(margin, height - margin); y < height; ++y) {
+            writer.writeRow(slot(y));
+        }
+        return true;
+    }
+
+    // Median-filters a PGM file into another without loading either one:
+    // only `window` input rows are held at a time, so peak memory grows
+    // with width * window rather than with the image size.
+    inline bool streamMedianFilter(const std::string& inputPath, const std::string& outputPath, int window = 3,
+                            MedianEngine engine = MedianEngine::Auto, PGMFormat format = PGMFormat::Binary) {
+        if (window <= 0 || window % 2 == 0) return false;
+        
+        PGMRowReader reader;
+        if (!reader.open(inputPath)) return false;
+        
+        const PGMHeader& header = reader.getHeader();
+        PGMRowWriter writer;
+        if (!writer.open(outputPath, format, header.width, header.height, header.maxValue)) return false;
+        
+        bool filtered = (header.maxValue > 255)
+            ? streamMedianRows<uint16_t>(reader, writer, window, engine)
+            : streamMedianRows<uint8_t>(reader, writer, window, engine);
+        return filtered && writer.close();
+    }
+
+    inline uint64_t mix64(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Counter-based random numbers: value i of stream s is a pure function
+    // of (seed, s, i), so every stream can be generated independently and in
+    // any order with the same result.
+    class CounterRandom {
+    private:
+        uint64_t key, counter;
+
+    public:
+        CounterRandom(uint64_t seed, uint64_t stream)
+            : key(mix64(seed ^ mix64(stream + 0x9E3779B97F4A7C15ull))), counter(0) {}
+
+        void fill(uint64_t* out, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = mix64(key + (counter + i) * 0x9E3779B97F4A7C15ull);
+            }
+            counter += count;
+        }
+
+        // Top 53 bits as a uniform double in (0, 1].
+        static double unit(uint64_t bits) {
+            return static_cast<double>((bits >> 11) + 1) * (1.0 / 9007199254740992.0);
+        }
+    };
+
+    const int kNoiseTileRows = 32;
+    const size_t kNoiseBatch = 64;
+
+    // Salt-and-pepper noise for one tile of kNoiseTileRows rows, drawn from
+    // the tile's own stream. The gaps between corrupted pixels are sampled
+    // geometrically, so the cost follows the number of corrupted pixels.
+    template <typename Pixel>
+    void impulseNoiseTile(PixelBuffer<Pixel>& pixels, double intensity, Pixel high, uint64_t seed, int tile) {
+        if (intensity <= 0.0) return;
+        int width = pixels.getWidth();
+        int rowBegin = tile * kNoiseTileRows;
+        int rowEnd = std::min(pixels.getHeight(), rowBegin + kNoiseTileRows);
+        double total = static_cast<double>(width) * (rowEnd - rowBegin);
+        double logKeep = (intensity < 1.0) ? std::log1p(-intensity) : 0.0;
+
+        CounterRandom random(seed, static_cast<uint64_t>(tile));
+        uint64_t batch[kNoiseBatch];
+        size_t used = kNoiseBatch;
+
+        for (double index = -1.0;;) {
+            if (used == kNoiseBatch) {
+                random.fill(batch, kNoiseBatch);
+                used = 0;
+            }
+            uint64_t bits = batch[used++];
+            // The top bits pick the gap and the lowest bit salt or pepper.
+            index += 1.0 + ((logKeep < 0.0) ? std::floor(std::log(CounterRandom::unit(bits)) / logKeep) : 0.0);
+            if (index >= total) break;
+
+            int64_t offset = static_cast<int64_t>(index);
+            pixels.row(rowBegin + static_cast<int>(offset / width))[offset % width] = (bits & 1) ? high : Pixel(0);
+        }
+    }
+
+    template <typename Pixel>
+    void addImpulseNoise(PixelBuffer<Pixel>& pixels, double intensity, Pixel high, uint64_t seed, WorkerPool* pool) {
+        int tiles = (pixels.getHeight() + kNoiseTileRows - 1) / kNoiseTileRows;
+        pixels.makeWritable();
+        auto noiseTile = [&](int tile) { impulseNoiseTile(pixels, intensity, high, seed, tile); };
+        if (pool) {
+            pool->parallelFor(tiles, noiseTile);
+        } else {
+            for (int tile = 0; tile < tiles; ++tile) noiseTile(tile);
+        }
+    }
+
+    class PGMHandler;
+
+    // Read-only view of a PGM image or of a rectangle in one, without a
+    // copy of the pixels. It refers to the handler's buffers, so it is only
+    // valid while the handler exists and is not modified.
+    class PGMView {
+    private:
+        ImageView<const uint8_t> gray8;
+        ImageView<const uint16_t> gray16;
+        int max_value;
+        bool wide;  // gray16 holds the pixels, whatever max_value is
+
+    public:
+        PGMView() : max_value(255), wide(false) {}
+        PGMView(ImageView<const uint8_t> pixels, int maxValue) : gray8(pixels), max_value(maxValue), wide(false) {}
+        PGMView(ImageView<const uint16_t> pixels, int maxValue) : gray16(pixels), max_value(maxValue), wide(true) {}
+        PGMView(const PGMHandler& image);
+
+        template <typename Visitor>
+        auto visitPixels(Visitor&& visit) const {
+            return is16Bit() ? visit(gray16) : visit(gray8);
+        }
+
+        PGMView region(const ImageRect& rect) const {
+            return is16Bit() ? PGMView(gray16.region(rect), max_value) : PGMView(gray8.region(rect), max_value);
+        }
+
+        int getWidth() const { return is16Bit() ? gray16.getWidth() : gray8.getWidth(); }
+        int getHeight() const { return is16Bit() ? gray16.getHeight() : gray8.getHeight(); }
+        int getMaxValue() const { return max_value; }
+        bool is16Bit() const { return wide; }
+        bool isGood() const { return getWidth() > 0 && getHeight() > 0; }
+    };
+
+    class PGMHandler {
+    private:
+        int w, h, max_value;
+        PixelBuffer<uint8_t> gray8;
+        PixelBuffer<uint16_t> gray16;
+
+        PixelBuffer<uint8_t>& buffer(uint8_t) { return gray8; }
+        PixelBuffer<uint16_t>& buffer(uint16_t) { return gray16; }
+
+        void allocate() {
+            if (is16Bit()) {
+                gray8.clear();
+                gray16.resize(w, h);
+            } else {
+                gray16.clear();
+                gray8.resize(w, h);
+            }
+        }
+
+        template <typename Pixel>
+        bool decodePlainRows(const unsigned char* cursor, const unsigned char* end, PixelBuffer<Pixel>& pixels) {
+            for (int row = 0; row < h; ++row) {
+                Pixel* line = pixels.row(row);
+                for (int col = 0; col < w; ++col) {
+                    int value;
+                    cursor = parseDecimal(skipSpaceAndComments(cursor, end), end, value);
+                    if (cursor == nullptr) return false;
+                    line[col] = static_cast<Pixel>(std::min(value, max_value));
+                }
+            }
+            return true;
+        }
+
+        // Calls filter(source, target) with views of the region: a copy of
+        // its pixels as they are, and the pixels in this image to overwrite.
+        // Only the region is copied, never the whole image.
+        template <typename Filter>
+        void filterRegion(const ImageRect& rect, Filter&& filter) {
+            visitPixels([&](auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                ImageView<Pixel> target = pixels.writableView().region(rect);
+                PixelBuffer<Pixel> source;
+                source.resize(target.getWidth(), target.getHeight());
+                for (int y = 0; y < target.getHeight(); ++y) {
+                    std::copy(target.row(y), target.row(y) + target.getWidth(), source.row(y));
+                }
+                filter(source.view(), target);
+            });
+        }
+
+        void decodeBinaryRows(const unsigned char* bytes, PixelBuffer<uint16_t>& pixels) {
+            for (int row = 0; row < h; ++row) {
+                const unsigned char* line = bytes + static_cast<size_t>(row) * w * 2;
+                uint16_t* out = pixels.row(row);
+                for (int col = 0; col < w; ++col) {
+                    int value = (line[2 * col] << 8) | line[2 * col + 1];
+                    out[col] = static_cast<uint16_t>(std::min(value, max_value));
+                }
+            }
+        }
+
+    public:
+        PGMHandler() : w(0), h(0), max_value(255) {}
+        
+        template <typename Visitor>
+        auto visitPixels(Visitor&& visit) {
+            return is16Bit() ? visit(gray16) : visit(gray8);
+        }
+        
+        template <typename Visitor>
+        auto visitPixels(Visitor&& visit) const {
+            return is16Bit() ? visit(gray16) : visit(gray8);
+        }
+        
+        bool readFile(const std::string& filename) {
+            auto file = std::make_shared<MappedFile>();
+            if (!file->open(filename)) return false;
+            
+            const unsigned char* begin = file->data();
+            const unsigned char* end = begin + file->size();
+            PGMHeader header;
+            if (!parsePGMHeader(begin, end, header)) return false;
+            
+            const unsigned char* raster = begin + header.dataOffset;
+            size_t sampleBytes = (header.maxValue > 255) ? 2 : 1;
+            size_t rowBytes = static_cast<size_t>(header.width) * sampleBytes;
+            if (header.binary && static_cast<size_t>(end - raster) / rowBytes < static_cast<size_t>(header.height)) {
+                return false;
+            }
+            
+            // Decode into a separate image so that a raster that fails to
+            // parse leaves this one untouched.
+            PGMHandler image;
+            image.w = header.width;
+            image.h = header.height;
+            image.max_value = header.maxValue;
+            
+            if (!header.binary) {
+                image.allocate();
+                bool decoded = image.visitPixels([&](auto& pixels) {
+                    return image.decodePlainRows(raster, end, pixels);
+                });
+                if (!decoded) return false;
+            } else if (!image.is16Bit()) {
+                image.gray8.adopt(raster, image.w, image.h, image.w, file);
+            } else {
+                image.allocate();
+                image.decodeBinaryRows(raster, image.gray16);
+            }
+            *this = std::move(image);
+            return true;
+        }
+        
+        bool writeFile(const std::string& filename, PGMFormat format = PGMFormat::Plain) const {
+            PGMRowWriter writer;
+            if (!writer.open(filename, format, w, h, max_value)) return false;
+            
+            visitPixels([&](const auto& pixels) { writer.writePixels(pixels); });
+            return writer.close();
+        }
+        
+        void introduceNoise(double intensity) {
+            std::random_device device;
+            uint64_t seed = (static_cast<uint64_t>(device()) << 32) | device();
+            introduceNoise(intensity, seed);
+        }
+        
+        // The same seed and intensity always corrupt the same pixels, for
+        // any number of threads.
+        void introduceNoise(double intensity, uint64_t seed, int threads = 1) {
+            if (threads != 1) {
+                WorkerPool pool(threads);
+                introduceNoise(intensity, seed, pool);
+                return;
+            }
+            
+            visitPixels([&](auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                addImpulseNoise(pixels, intensity, static_cast<Pixel>(max_value), seed, nullptr);
+            });
+        }
+        
+        void introduceNoise(double intensity, uint64_t seed, WorkerPool& pool) {
+            visitPixels([&](auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                addImpulseNoise(pixels, intensity, static_cast<Pixel>(max_value), seed, &pool);
+            });
+        }
+        
+        void useMedianFilter(int window = 3, MedianEngine engine = MedianEngine::Auto, int threads = 1) {
+            if (window <= 0 || window % 2 == 0) return;
+            
+            if (threads != 1) {
+                WorkerPool pool(threads);
+                useMedianFilter(window, engine, pool);
+                return;
+            }
+            
+            visitPixels([&](auto& pixels) {
+                auto result = pixels;
+                medianFilter(pixels, result, window, engine, max_value);
+                pixels = std::move(result);
+            });
+        }
+        
+        void useMedianFilter(int window, MedianEngine engine, WorkerPool& pool) {
+            if (window <= 0 || window % 2 == 0) return;
+            
+            visitPixels([&](auto& pixels) {
+                auto result = pixels;
+                medianFilter(pixels, result, window, engine, max_value, pool);
+                pixels = std::move(result);
+            });
+        }
+        
+        // Returns a filtered copy without modifying this image; the result
+        // is the only new buffer, unlike copying and then filtering in place.
+        PGMHandler medianFiltered(int window = 3, MedianEngine engine = MedianEngine::Auto) const {
+            PGMHandler result(*this);
+            if (window <= 0 || window % 2 == 0) return result;
+            
+            visitPixels([&](const auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                medianFilter(pixels, result.buffer(Pixel()), window, engine, max_value);
+            });
+            return result;
+        }
+        
+        // Replaces only the salt-and-pepper impulses (pixels at 0 or
+        // max_value), growing the window up to maxWindow where needed.
+        void useAdaptiveMedianFilter(int maxWindow = 7, int threads = 1) {
+            if (maxWindow < 3 || maxWindow % 2 == 0) return;
+            
+            if (threads != 1) {
+                WorkerPool pool(threads);
+                useAdaptiveMedianFilter(maxWindow, pool);
+                return;
+            }
+            
+            visitPixels([&](auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                auto result = pixels;
+                adaptiveMedianFilter(pixels, result, maxWindow, static_cast<Pixel>(max_value));
+                pixels = std::move(result);
+            });
+        }
+        
+        void useAdaptiveMedianFilter(int maxWindow, WorkerPool& pool) {
+            if (maxWindow < 3 || maxWindow % 2 == 0) return;
+            
+            visitPixels([&](auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                auto result = pixels;
+                adaptiveMedianFilter(pixels, result, maxWindow, static_cast<Pixel>(max_value), pool);
+                pixels = std::move(result);
+            });
+        }
+        
+        PGMHandler adaptiveMedianFiltered(int maxWindow = 7) const {
+            PGMHandler result(*this);
+            if (maxWindow < 3 || maxWindow % 2 == 0) return result;
+            
+            visitPixels([&](const auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                adaptiveMedianFilter(pixels, result.buffer(Pixel()), maxWindow, static_cast<Pixel>(max_value));
+            });
+            return result;
+        }
+        
+        // Mean over a window x window neighbourhood, edges replicated.
+        void useBoxFilter(int window = 3) {
+            if (window <= 0 || window % 2 == 0) return;
+            *this = boxFiltered(window);
+        }
+        
+        PGMHandler boxFiltered(int window = 3) const {
+            PGMHandler result(*this);
+            if (window <= 0 || window % 2 == 0) return result;
+            
+            visitPixels([&](const auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                boxFilter(pixels, result.buffer(Pixel()), window / 2);
+            });
+            return result;
+        }
+        
+        void useGaussianFilter(double sigma) {
+            if (sigma <= 0.0) return;
+            *this = gaussianFiltered(sigma);
+        }
+        
+        PGMHandler gaussianFiltered(double sigma) const {
+            PGMHandler result(*this);
+            if (sigma <= 0.0) return result;
+            
+            visitPixels([&](const auto& pixels) {
+                using Pixel = typename std::decay_t<decltype(pixels)>::PixelType;
+                gaussianFilter(pixels, result.buffer(Pixel()), sigma);
+            });
+            return result;
+        }
+        
+        PGMView view() const {
+            return is16Bit() ? PGMView(gray16.view(), max_value) : PGMView(gray8.view(), max_value);
+        }
+        
+        PGMView region(const ImageRect& rect) const { return view().region(rect); }
+        
+        // Region variants filter only the part of rect inside the image, in
+        // place, as if it were an image of its own; the rest is untouched.
+        void useMedianFilter(const ImageRect& rect, int window = 3, MedianEngine engine = MedianEngine::Auto) {
+            if (window <= 0 || window % 2 == 0) return;
+            filterRegion(rect, [&](auto source, auto target) { medianFilter(source, target, window, engine, max_value); });
+        }
+        
+        void useAdaptiveMedianFilter(const ImageRect& rect, int maxWindow = 7) {
+            if (maxWindow < 3 || maxWindow % 2 == 0) return;
+            filterRegion(rect, [&](auto source, auto target) {
+                using Pixel = typename decltype(target)::PixelType;
+                adaptiveMedianFilter(source, target, maxWindow, static_cast<Pixel>(max_value));
+            });
+        }
+        
+        void useBoxFilter(const ImageRect& rect, int window = 3) {
+            if (window <= 0 || window % 2 == 0) return;
+            filterRegion(rect, [&](auto source, auto target) { boxFilter(source, target, window / 2); });
+        }
+        
+        void useGaussianFilter(const ImageRect& rect, double sigma) {
+            if (sigma <= 0.0) return;
+            filterRegion(rect, [&](auto source, auto target) { gaussianFilter(source, target, sigma); });
+        }
+        
+        int getWidth() const { return w; }
+        int getHeight() const { return h; }
+        int getMaxValue() const { return max_value; }
+        bool is16Bit() const { return max_value > 255; }
+        const PixelBuffer<uint8_t>& pixels8() const { return gray8; }
+        const PixelBuffer<uint16_t>& pixels16() const { return gray16; }
+        int getValue(int x, int y) const { 
+            if (x < 0 || x >= w || y < 0 || y >= h) return 0;
+            return is16Bit() ? gray16.row(y)[x] : gray8.row(y)[x];
+        }
+        bool isGood() const { return w > 0 && h > 0; }
+    };
+
+    inline PGMView::PGMView(const PGMHandler& image) : PGMView(image.view()) {}
+
+    template <typename PixelA, typename PixelB>
+    double sumSquaredDifference(ImageView<const PixelA> a, ImageView<const PixelB> b) {
+        double total = 0.0;
+        for (int y = 0; y < a.getHeight(); ++y) {
+            const PixelA* lineA = a.row(y);
+            const PixelB* lineB = b.row(y);
+            for (int x = 0; x < a.getWidth(); ++x) {
+                double diff = static_cast<double>(lineA[x]) - static_cast<double>(lineB[x]);
+                total += diff * diff;
+            }
+        }
+        return total;
+    }
+
+    template <typename PixelA, typename PixelB>
+    double structuralSimilarity(ImageView<const PixelA> a, ImageView<const PixelB> b, double peak) {
+        int width = a.getWidth();
+        int height = a.getHeight();
+        int total = width * height;
+        
+        double mean1 = 0.0, mean2 = 0.0;
+        for (int y = 0; y < height; ++y) {
+            const PixelA* lineA = a.row(y);
+            const PixelB* lineB = b.row(y);
+            for (int x = 0; x < width; ++x) {
+                mean1 += lineA[x];
+                mean2 += lineB[x];
+            }
+        }
+        mean1 /= total;
+        mean2 /= total;
+        
+        double var1 = 0.0, var2 = 0.0, covar = 0.0;
+        for (int y = 0; y < height; ++y) {
+            const PixelA* lineA = a.row(y);
+            const PixelB* lineB = b.row(y);
+            for (int x = 0; x < width; ++x) {
+                double d1 = lineA[x] - mean1;
+                double d2 = lineB[x] - mean2;
+                var1 += d1 * d1;
+                var2 += d2 * d2;
+                covar += d1 * d2;
+            }
+        }
+        
+        const double C1 = (0.01 * peak) * (0.01 * peak), C2 = (0.03 * peak) * (0.03 * peak);
+        double num = (2 * mean1 * mean2 + C1) * (2 * covar + C2);
+        double den = (mean1 * mean1 + mean2 * mean2 + C1) * (var1 + var2 + C2);
+        
+        return (den == 0.0) ? 1.0 : num / den;
+    }
+
+    // Dynamic range used by PSNR and SSIM, so 16-bit images are not scored
+    // against an 8-bit peak.
+    inline double samplePeak(const PGMView& img1, const PGMView& img2) {
+        return std::max(img1.getMaxValue(), img2.getMaxValue());
+    }
+
+    inline double computeMSE(const PGMView& img1, const PGMView& img2) {
+        if (!img1.isGood() || !img2.isGood()) return -1.0;
+        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return -1.0;
+        
+        int pixels = img1.getWidth() * img1.getHeight();
+        double total = img1.visitPixels([&](const auto& a) {
+            return img2.visitPixels([&](const auto& b) { return sumSquaredDifference(a, b); });
+        });
+        return total / pixels;
+    }
+
+    inline double computePSNR(const PGMView& img1, const PGMView& img2) {
+        double mse = computeMSE(img1, img2);
+        double peak = samplePeak(img1, img2);
+        return (mse <= 0.0) ? -1.0 : 10.0 * log10((peak * peak) / mse);
+    }
+
+    inline double computeSSIM(const PGMView& img1, const PGMView& img2) {
+        if (!img1.isGood() || !img2.isGood()) return -1.0;
+        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return -1.0;
+        
+        double peak = samplePeak(img1, img2);
+        return img1.visitPixels([&](const auto& a) {
+            return img2.visitPixels([&](const auto& b) { return structuralSimilarity(a, b, peak); });
+        });
+    }
+
+    struct QualityMetrics {
+        double mse, psnr, ssim;
+    };
+
+    // Exact integer sums over a pair of images, from which MSE, PSNR and the
+    // global SSIM all follow; partial sums of row bands merge losslessly.
+    struct PixelMoments {
+        uint64_t count, sumA, sumB, sumAA, sumBB, sumAB;
+
+        PixelMoments() : count(0), sumA(0), sumB(0), sumAA(0), sumBB(0), sumAB(0) {}
+
+        void merge(const PixelMoments& other) {
+            count += other.count;
+            sumA += other.sumA;
+            sumB += other.sumB;
+            sumAA += other.sumAA;
+            sumBB += other.sumBB;
+            sumAB += other.sumAB;
+        }
+    };
+
+    template <typename PixelA, typename PixelB>
+    void accumulateMoments(const PixelA* a, const PixelB* b, int width, PixelMoments& moments) {
+        uint64_t sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+        for (int x = 0; x < width; ++x) {
+            uint64_t va = a[x], vb = b[x];
+            sumA += va;
+            sumB += vb;
+            sumAA += va * va;
+            sumBB += vb * vb;
+            sumAB += va * vb;
+        }
+        moments.count += width;
+        moments.sumA += sumA;
+        moments.sumB += sumB;
+        moments.sumAA += sumAA;
+        moments.sumBB += sumBB;
+        moments.sumAB += sumAB;
+    }
+
+#ifdef PZ3_HAVE_SSE2
+    inline uint64_t horizontalSum32(__m128i lanes) {
+        alignas(16) uint32_t parts[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(parts), lanes);
+        return static_cast<uint64_t>(parts[0]) + parts[1] + parts[2] + parts[3];
+    }
+
+    inline uint64_t horizontalSum64(__m128i lanes) {
+        alignas(16) uint64_t parts[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(parts), lanes);
+        return parts[0] + parts[1];
+    }
+
+    inline void accumulateMoments(const uint8_t* a, const uint8_t* b, int width, PixelMoments& moments) {
+        // Each 32-bit lane gains at most 4 * 255 * 255 per step, so 4096 steps
+        // fit before the lanes have to be widened into the 64-bit totals.
+        const int kStepsPerFlush = 4096;
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+
+        while (x + 16 <= width) {
+            int blockEnd = std::min(width, x + 16 * kStepsPerFlush);
+            __m128i sumA = zero, sumB = zero, sumAA = zero, sumBB = zero, sumAB = zero;
+            for (; x + 16 <= blockEnd; x += 16) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+                sumA = _mm_add_epi64(sumA, _mm_sad_epu8(va, zero));
+                sumB = _mm_add_epi64(sumB, _mm_sad_epu8(vb, zero));
+
+                __m128i aLow = _mm_unpacklo_epi8(va, zero), aHigh = _mm_unpackhi_epi8(va, zero);
+                __m128i bLow = _mm_unpacklo_epi8(vb, zero), bHigh = _mm_unpackhi_epi8(vb, zero);
+                sumAA = _mm_add_epi32(sumAA, _mm_add_epi32(_mm_madd_epi16(aLow, aLow), _mm_madd_epi16(aHigh, aHigh)));
+                sumBB = _mm_add_epi32(sumBB, _mm_add_epi32(_mm_madd_epi16(bLow, bLow), _mm_madd_epi16(bHigh, bHigh)));
+                sumAB = _mm_add_epi32(sumAB, _mm_add_epi32(_mm_madd_epi16(aLow, bLow), _mm_madd_epi16(aHigh, bHigh)));
+            }
+            moments.sumA += horizontalSum64(sumA);
+            moments.sumB += horizontalSum64(sumB);
+            moments.sumAA += horizontalSum32(sumAA);
+            moments.sumBB += horizontalSum32(sumBB);
+            moments.sumAB += horizontalSum32(sumAB);
+        }
+        moments.count += x;
+        accumulateMoments<uint8_t, uint8_t>(a + x, b + x, width - x, moments);
+    }
+
+    // Products of 16-bit samples need all 32 bits unsigned, so they are put
+    // together from the low and high halves and widened into 64-bit lanes.
+    inline __m128i addProducts(__m128i total, __m128i a, __m128i b) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_mullo_epi16(a, b), high = _mm_mulhi_epu16(a, b);
+        __m128i first = _mm_unpacklo_epi16(low, high), second = _mm_unpackhi_epi16(low, high);
+        total = _mm_add_epi64(total, _mm_add_epi64(_mm_unpacklo_epi32(first, zero), _mm_unpackhi_epi32(first, zero)));
+        return _mm_add_epi64(total, _mm_add_epi64(_mm_unpacklo_epi32(second, zero), _mm_unpackhi_epi32(second, zero)));
+    }
+
+    inline void accumulateMoments(const uint16_t* a, const uint16_t* b, int width, PixelMoments& moments) {
+        // Each 32-bit sum lane gains at most 2 * 65535 per step.
+        const int kStepsPerFlush = 4096;
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+
+        while (x + 8 <= width) {
+            int blockEnd = std::min(width, x + 8 * kStepsPerFlush);
+            __m128i sumA = zero, sumB = zero, sumAA = zero, sumBB = zero, sumAB = zero;
+            for (; x + 8 <= blockEnd; x += 8) {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x));
+                sumA = _mm_add_epi32(sumA, _mm_add_epi32(_mm_unpacklo_epi16(va, zero), _mm_unpackhi_epi16(va, zero)));
+                sumB = _mm_add_epi32(sumB, _mm_add_epi32(_mm_unpacklo_epi16(vb, zero), _mm_unpackhi_epi16(vb, zero)));
+                sumAA = addProducts(sumAA, va, va);
+                sumBB = addProducts(sumBB, vb, vb);
+                sumAB = addProducts(sumAB, va, vb);
+            }
+            moments.sumA += horizontalSum32(sumA);
+            moments.sumB += horizontalSum32(sumB);
+            moments.sumAA += horizontalSum64(sumAA);
+            moments.sumBB += horizontalSum64(sumBB);
+            moments.sumAB += horizontalSum64(sumAB);
+        }
+        moments.count += x;
+        accumulateMoments<uint16_t, uint16_t>(a + x, b + x, width - x, moments);
+    }
+#endif
+
+    template <typename PixelA, typename PixelB>
+    PixelMoments measureMoments(ImageView<const PixelA> a, ImageView<const PixelB> b, int rowBegin, int rowEnd) {
+        PixelMoments moments;
+        for (int y = rowBegin; y < rowEnd; ++y) {
+            accumulateMoments(a.row(y), b.row(y), a.getWidth(), moments);
+        }
+        return moments;
+    }
+
+    inline QualityMetrics metricsFromMoments(const PixelMoments& moments, double peak) {
+        double n = static_cast<double>(moments.count);
+        double sumA = static_cast<double>(moments.sumA);
+        double sumB = static_cast<double>(moments.sumB);
+        double squaredError = static_cast<double>(moments.sumAA + moments.sumBB - 2 * moments.sumAB);
+
+        QualityMetrics metrics;
+        metrics.mse = squaredError / n;
+        metrics.psnr = (metrics.mse <= 0.0) ? -1.0 : 10.0 * log10((peak * peak) / metrics.mse);
+
+        double mean1 = sumA / n;
+        double mean2 = sumB / n;
+        double var1 = static_cast<double>(moments.sumAA) - sumA * mean1;
+        double var2 = static_cast<double>(moments.sumBB) - sumB * mean2;
+        double covar = static_cast<double>(moments.sumAB) - sumA * mean2;
+
+        const double C1 = (0.01 * peak) * (0.01 * peak), C2 = (0.03 * peak) * (0.03 * peak);
+        double num = (2 * mean1 * mean2 + C1) * (2 * covar + C2);
+        double den = (mean1 * mean1 + mean2 * mean2 + C1) * (var1 + var2 + C2);
+        metrics.ssim = (den == 0.0) ? 1.0 : num / den;
+        return metrics;
+    }
+
+    inline QualityMetrics measureQuality(const PGMView& img1, const PGMView& img2, WorkerPool* pool) {
+        QualityMetrics invalid = { -1.0, -1.0, -1.0 };
+        if (!img1.isGood() || !img2.isGood()) return invalid;
+        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return invalid;
+        
+        int height = img1.getHeight();
+        int bands = pool ? std::min(height, pool->size() * 4) : 1;
+        std::vector<PixelMoments> partial(bands);
+        
+        auto measureBand = [&](int band) {
+            int rowBegin = static_cast<int>(static_cast<int64_t>(height) * band / bands);
+            int rowEnd = static_cast<int>(static_cast<int64_t>(height) * (band + 1) / bands);
+            partial[band] = img1.visitPixels([&](const auto& a) {
+                return img2.visitPixels([&](const auto& b) { return measureMoments(a, b, rowBegin, rowEnd); });
+            });
+        };
+        if (pool) {
+            pool->parallelFor(bands, measureBand);
+        } else {
+            measureBand(0);
+        }
+        
+        PixelMoments total;
+        for (const auto& moments : partial) total.merge(moments);
+        return metricsFromMoments(total, samplePeak(img1, img2));
+    }
+
+    // MSE, PSNR and global SSIM from a single pass over both images; the
+    // values agree with computeMSE/computePSNR/computeSSIM up to rounding.
+    inline QualityMetrics computeQualityMetrics(const PGMView& img1, const PGMView& img2) {
+        return measureQuality(img1, img2, nullptr);
+    }
+
+    inline QualityMetrics computeQualityMetrics(const PGMView& img1, const PGMView& img2, WorkerPool& pool) {
+        return measureQuality(img1, img2, &pool);
+    }
+
+    // One row of summed-area tables for x, y, x^2, y^2 and xy: entry i holds
+    // the sums over columns [0, i) of every row accumulated so far.
+    struct IntegralRow {
+        std::vector<uint64_t> a, b, aa, bb, ab;
+
+        void reset(int width) {
+            a.assign(width + 1, 0);
+            b.assign(width + 1, 0);
+            aa.assign(width + 1, 0);
+            bb.assign(width + 1, 0);
+            ab.assign(width + 1, 0);
+        }
+    };
+
+    template <typename PixelA, typename PixelB>
+    void accumulateIntegralRow(const IntegralRow& above, const PixelA* lineA, const PixelB* lineB,
+                               int width, IntegralRow& row) {
+        uint64_t sumA = 0, sumB = 0, sumAA = 0, sumBB = 0, sumAB = 0;
+        for (int x = 0; x < width; ++x) {
+            uint64_t va = lineA[x], vb = lineB[x];
+            sumA += va;
+            sumB += vb;
+            sumAA += va * va;
+            sumBB += vb * vb;
+            sumAB += va * vb;
+            row.a[x + 1] = above.a[x + 1] + sumA;
+            row.b[x + 1] = above.b[x + 1] + sumB;
+            row.aa[x + 1] = above.aa[x + 1] + sumAA;
+            row.bb[x + 1] = above.bb[x + 1] + sumBB;
+            row.ab[x + 1] = above.ab[x + 1] + sumAB;
+        }
+    }
+
+    inline uint64_t windowSum(const std::vector<uint64_t>& top, const std::vector<uint64_t>& bottom, int x, int window) {
+        return bottom[x + window] - bottom[x] - top[x + window] + top[x];
+    }
+
+#if defined(__SIZEOF_INT128__)
+    using WideSum = __int128;
+#else
+    using WideSum = double;
+#endif
+
+    // SSIM of one block from its window sums, scaled by n^2 throughout so
+    // the variances come from exact integer differences instead of
+    // cancelling doubles. The scaled terms reach 2 * n^2 * peak^2, so Sum is
+    // int64_t only while that fits; larger 16-bit windows use WideSum.
+    template <typename Sum>
+    double blockSSIM(Sum n, Sum sumA, Sum sumB, Sum sumAA, Sum sumBB, Sum sumAB, double c1, double c2) {
+        double meanProduct = static_cast<double>(sumA * sumB);
+        double meanSquares = static_cast<double>(sumA * sumA + sumB * sumB);
+        double variances = static_cast<double>(n * (sumAA + sumBB) - sumA * sumA - sumB * sumB);
+        double covariance = static_cast<double>(n * sumAB - sumA * sumB);
+        return ((2 * meanProduct + c1) * (2 * covariance + c2)) / ((meanSquares + c1) * (variances + c2));
+    }
+
+    // SSIM over the window-by-window blocks whose top rows are in
+    // [mapBegin, mapEnd). Only window + 1 table rows are kept: they are
+    // built relative to row mapBegin, which the differences cancel out.
+    template <typename PixelA, typename PixelB>
+    double windowedSSIMRows(ImageView<const PixelA> a, ImageView<const PixelB> b, int window, double peak,
+                            int mapBegin, int mapEnd, PixelBuffer<float>* map) {
+        int width = a.getWidth();
+        int mapWidth = width - window + 1;
+        int64_t n = static_cast<int64_t>(window) * window;
+        double nn = static_cast<double>(n) * n;
+        double c1 = (0.01 * peak) * (0.01 * peak) * nn;
+        double c2 = (0.03 * peak) * (0.03 * peak) * nn;
+        bool fits64 = 2.0 * nn * peak * peak < 9.0e18;
+
+        std::vector<IntegralRow> tables(window + 1);
+        for (auto& table : tables) table.reset(width);
+        for (int r = 1; r <= window; ++r) {
+            int y = mapBegin + r - 1;
+            accumulateIntegralRow(tables[r - 1], a.row(y), b.row(y), width, tables[r]);
+        }
+
+        double total = 0.0;
+        for (int y = mapBegin; y < mapEnd; ++y) {
+            int r = y - mapBegin;
+            const IntegralRow& top = tables[r % (window + 1)];
+            const IntegralRow& bottom = tables[(r + window) % (window + 1)];
+            float* out = map ? map->row(y) : nullptr;
+
+            for (int x = 0; x < mapWidth; ++x) {
+                int64_t sumA = static_cast<int64_t>(windowSum(top.a, bottom.a, x, window));
+                int64_t sumB = static_cast<int64_t>(windowSum(top.b, bottom.b, x, window));
+                int64_t sumAA = static_cast<int64_t>(windowSum(top.aa, bottom.aa, x, window));
+                int64_t sumBB = static_cast<int64_t>(windowSum(top.bb, bottom.bb, x, window));
+                int64_t sumAB = static_cast<int64_t>(windowSum(top.ab, bottom.ab, x, window));
+
+                double ssim = fits64
+                    ? blockSSIM<int64_t>(n, sumA, sumB, sumAA, sumBB, sumAB, c1, c2)
+                    : blockSSIM<WideSum>(n, sumA, sumB, sumAA, sumBB, sumAB, c1, c2);
+                total += ssim;
+                if (out) out[x] = static_cast<float>(ssim);
+            }
+
+            if (y + 1 < mapEnd) {
+                int next = r + window + 1;
+                accumulateIntegralRow(tables[(next - 1) % (window + 1)], a.row(y + window), b.row(y + window),
+                                      width, tables[next % (window + 1)]);
+            }
+        }
+        return total;
+    }
+
+    const int kSSIMWindow = 7;
+
+    inline double measureWindowedSSIM(const PGMView& img1, const PGMView& img2, int window,
+                               PixelBuffer<float>* map, WorkerPool* pool) {
+        if (!img1.isGood() || !img2.isGood()) return -1.0;
+        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return -1.0;
+        
+        window = std::max(1, std::min(window, std::min(img1.getWidth(), img1.getHeight())));
+        int mapWidth = img1.getWidth() - window + 1;
+        int mapHeight = img1.getHeight() - window + 1;
+        if (map) map->resize(mapWidth, mapHeight);
+        
+        int bands = pool ? std::min(mapHeight, pool->size() * 4) : 1;
+        std::vector<double> partial(bands, 0.0);
+        double peak = samplePeak(img1, img2);
+        
+        auto measureBand = [&](int band) {
+            int mapBegin = static_cast<int>(static_cast<int64_t>(mapHeight) * band / bands);
+            int mapEnd = static_cast<int>(static_cast<int64_t>(mapHeight) * (band + 1) / bands);
+            partial[band] = img1.visitPixels([&](const auto& a) {
+                return img2.visitPixels([&](const auto& b) {
+                    return windowedSSIMRows(a, b, window, peak, mapBegin, mapEnd, map);
+                });
+            });
+        };
+        if (pool) {
+            pool->parallelFor(bands, measureBand);
+        } else {
+            measureBand(0);
+        }
+        
+        double total = 0.0;
+        for (double sum : partial) total += sum;
+        return total / (static_cast<double>(mapWidth) * mapHeight);
+    }
+
+    // Mean SSIM over every window-by-window block (uniform weights, "valid"
+    // placement), with O(1) statistics per block from summed-area tables.
+    // When map is given it receives the local SSIM of each block, indexed by
+    // the block's top-left pixel.
+    inline double computeWindowedSSIM(const PGMView& img1, const PGMView& img2, int window = kSSIMWindow,
+                               PixelBuffer<float>* map = nullptr) {
+        return measureWindowedSSIM(img1, img2, window, map, nullptr);
+    }
+
+    inline double computeWindowedSSIM(const PGMView& img1, const PGMView& img2, WorkerPool& pool,
+                               int window = kSSIMWindow, PixelBuffer<float>* map = nullptr) {
+        return measureWindowedSSIM(img1, img2, window, map, &pool);
+    }
+
+    // Work-stealing task pool: each worker pushes and pops its own deque
+    // LIFO, so one photo's stages run depth-first, and idle workers steal
+    // the oldest task from another worker's deque.
+    class TaskScheduler {
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex stateLock;
+        std::condition_variable wake, idle;
+        std::atomic<int> queued, outstanding;
+        std::atomic<unsigned> nextQueue;
+        std::exception_ptr failure;
+        bool stopping;
+
+        static std::pair<TaskScheduler*, int>& currentWorker() {
+            static thread_local std::pair<TaskScheduler*, int> worker(nullptr, -1);
+            return worker;
+        }
+
+        bool tryPop(int self, std::function<void()>& task) {
+            int count = static_cast<int>(queues.size());
+            for (int i = 0; i < count; ++i) {
+                Queue& queue = *queues[(self + i) % count];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                if (queue.tasks.empty()) continue;
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                } else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                --queued;
+                return true;
+            }
+            return false;
+        }
+
+        void workerLoop(int self) {
+            currentWorker() = std::make_pair(this, self);
+            while (true) {
+                std::function<void()> task;
+                if (tryPop(self, task)) {
+                    try {
+                        task();
+                    } catch (...) {
+                        std::lock_guard<std::mutex> guard(stateLock);
+                        if (!failure) failure = std::current_exception();
+                    }
+                    // Release what the task captured before wait() can return.
+                    task = nullptr;
+                    if (--outstanding == 0) {
+                        std::lock_guard<std::mutex> guard(stateLock);
+                        idle.notify_all();
+                    }
+                    continue;
+                }
+                std::unique_lock<std::mutex> guard(stateLock);
+                wake.wait(guard, [&] { return stopping || queued > 0; });
+                if (stopping) return;
+            }
+        }
+
+    public:
+        explicit TaskScheduler(int threads = 0) : queued(0), outstanding(0), nextQueue(0), stopping(false) {
+            if (threads <= 0) {
+                threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+            }
+            for (int i = 0; i < threads; ++i) {
+                queues.emplace_back(new Queue());
+            }
+            for (int i = 0; i < threads; ++i) {
+                workers.emplace_back(&TaskScheduler::workerLoop, this, i);
+            }
+        }
+
+        ~TaskScheduler() {
+            {
+                std::lock_guard<std::mutex> guard(stateLock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& worker : workers) worker.join();
+        }
+
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        void submit(std::function<void()> task) {
+            const auto& worker = currentWorker();
+            int index = (worker.first == this)
+                ? worker.second
+                : static_cast<int>(nextQueue++ % queues.size());
+            
+            ++outstanding;
+            {
+                std::lock_guard<std::mutex> guard(queues[index]->lock);
+                queues[index]->tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard<std::mutex> guard(stateLock);
+                ++queued;
+            }
+            wake.notify_one();
+        }
+
+        // Blocks until every submitted task, including the ones tasks
+        // submitted themselves, has finished; rethrows the first failure.
+        void wait() {
+            std::unique_lock<std::mutex> guard(stateLock);
+            idle.wait(guard, [&] { return outstanding == 0; });
+            if (failure) {
+                std::exception_ptr error = failure;
+                failure = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+    };
+
+    enum class Stage { Decode, ReadWait, Noise, Filter, Metrics, Encode, WriteWait, Count };
+
+    inline const char* stageName(Stage stage) {
+        static const char* const names[] = { "decode", "waiting for reads", "noise", "filter", "metrics",
+                                             "encode", "waiting for writes" };
+        return names[static_cast<int>(stage)];
+    }
+
+    // Busy time, calls, pixels and bytes read and written per stage, summed
+    // over every thread that ran it. Each thread adds to a block of its own,
+    // so recording never contends; total() sums the blocks once the work
+    // is done. Building with PZ3_NO_STAGE_STATS compiles the recording out.
+    class StageStats {
+    public:
+        struct Totals {
+            int64_t calls = 0, nanos = 0, pixels = 0, bytesRead = 0, bytesWritten = 0;
+        };
+
+    private:
+        enum Field { Calls, Nanos, Pixels, BytesRead, BytesWritten, FieldCount };
+
+        // Only the owning thread writes a block, so relaxed loads and stores
+        // suffice and no locked instruction is needed.
+        struct ThreadBlock {
+            std::atomic<int64_t> values[static_cast<int>(Stage::Count)][FieldCount];
+
+            ThreadBlock() {
+                for (auto& stage : values) {
+                    for (auto& value : stage) value.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            void add(Stage stage, Field field, int64_t amount) {
+                std::atomic<int64_t>& value = values[static_cast<int>(stage)][field];
+                value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+        };
+
+        uint64_t id;
+        mutable std::mutex lock;
+        std::deque<ThreadBlock> blocks;
+        std::unordered_map<std::thread::id, ThreadBlock*> threadBlocks;
+
+        static uint64_t nextId() {
+            static std::atomic<uint64_t> counter(0);
+            return ++counter;
+        }
+
+        // The thread_local pair only caches the last instance this thread
+        // used; a thread that switches between instances finds its block
+        // again in threadBlocks instead of adding another one.
+        ThreadBlock& local() {
+            thread_local uint64_t owner = 0;
+            thread_local ThreadBlock* block = nullptr;
+            if (owner != id) {
+                std::lock_guard<std::mutex> guard(lock);
+                ThreadBlock*& entry = threadBlocks[std::this_thread::get_id()];
+                if (!entry) {
+                    blocks.emplace_back();
+                    entry = &blocks.back();
+                }
+                block = entry;
+                owner = id;
+            }
+            return *block;
+        }
+
+    public:
+        StageStats() : id(nextId()) {}
+
+        StageStats(const StageStats&) = delete;
+        StageStats& operator=(const StageStats&) = delete;
+
+        void record(Stage stage, std::chrono::steady_clock::duration elapsed, int64_t pixels,
+                    int64_t bytesRead, int64_t bytesWritten) {
+            ThreadBlock& block = local();
+            block.add(stage, Calls, 1);
+            block.add(stage, Nanos, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            block.add(stage, Pixels, pixels);
+            block.add(stage, BytesRead, bytesRead);
+            block.add(stage, BytesWritten, bytesWritten);
+        }
+
+        Totals total(Stage stage) const {
+            Totals totals;
+            std::lock_guard<std::mutex> guard(lock);
+            for (const auto& block : blocks) {
+                const auto& values = block.values[static_cast<int>(stage)];
+                totals.calls += values[Calls].load(std::memory_order_relaxed);
+                totals.nanos += values[Nanos].load(std::memory_order_relaxed);
+                totals.pixels += values[Pixels].load(std::memory_order_relaxed);
+                totals.bytesRead += values[BytesRead].load(std::memory_order_relaxed);
+                totals.bytesWritten += values[BytesWritten].load(std::memory_order_relaxed);
+            }
+            return totals;
+        }
+
+        double seconds(Stage stage) const {
+            return static_cast<double>(total(stage).nanos) * 1e-9;
+        }
+    };
+
+    // Times its scope as one call of a stage; the work done in it is
+    // reported with addWork() before the scope ends.
+    class ScopedStage {
+    private:
+        StageStats& stats;
+        Stage stage;
+        int64_t pixels, bytesRead, bytesWritten;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        ScopedStage(StageStats& stageStats, Stage timedStage)
+            : stats(stageStats), stage(timedStage), pixels(0), bytesRead(0), bytesWritten(0) {
+#ifndef PZ3_NO_STAGE_STATS
+            start = std::chrono::steady_clock::now();
+#endif
+        }
+
+        ~ScopedStage() {
+#ifndef PZ3_NO_STAGE_STATS
+            stats.record(stage, std::chrono::steady_clock::now() - start, pixels, bytesRead, bytesWritten);
+#endif
+        }
+
+        ScopedStage(const ScopedStage&) = delete;
+        ScopedStage& operator=(const ScopedStage&) = delete;
+
+        void addWork(int64_t pixelCount, int64_t readBytes, int64_t writtenBytes) {
+            pixels += pixelCount;
+            bytesRead += readBytes;
+            bytesWritten += writtenBytes;
+        }
+    };
+
+    // One row per stage: calls, busy seconds summed over threads, and the
+    // pixels and bytes handled, with rates per busy second.
+    inline bool writeStageReport(const std::string& path, const StageStats& stats) {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << "Stage,Calls,Seconds,Pixels,PixelsPerSecond,BytesRead,BytesWritten,BytesPerSecond\n";
+        for (int index = 0; index < static_cast<int>(Stage::Count); ++index) {
+            Stage stage = static_cast<Stage>(index);
+            StageStats::Totals totals = stats.total(stage);
+            double seconds = static_cast<double>(totals.nanos) * 1e-9;
+            double rate = (seconds > 0.0) ? 1.0 / seconds : 0.0;
+            file << stageName(stage) << ","
+                 << totals.calls << ","
+                 << seconds << ","
+                 << totals.pixels << ","
+                 << totals.pixels * rate << ","
+                 << totals.bytesRead << ","
+                 << totals.bytesWritten << ","
+                 << (totals.bytesRead + totals.bytesWritten) * rate << "\n";
+        }
+        return file.good();
+    }
+
+    // Runs load(0), load(1), ... on a dedicated thread, at most depth items
+    // ahead of the consumer, which takes them in order with next().
+    template <typename Item>
+    class Prefetcher {
+    private:
+        std::function<Item(size_t)> load;
+        size_t count, depth, produced, taken;
+        std::deque<Item> ready;
+        std::mutex lock;
+        std::condition_variable changed;
+        std::exception_ptr failure;
+        bool stopping;
+        std::thread reader;
+
+        void readLoop() {
+            for (size_t index = 0; index < count; ++index) {
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    changed.wait(guard, [&] { return stopping || produced - taken < depth; });
+                    if (stopping) return;
+                }
+                try {
+                    Item item = load(index);
+                    std::lock_guard<std::mutex> guard(lock);
+                    ready.push_back(std::move(item));
+                    ++produced;
+                } catch (...) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    failure = std::current_exception();
+                    produced = count;
+                }
+                changed.notify_all();
+                if (failure) return;
+            }
+        }
+
+    public:
+        Prefetcher(size_t items, size_t lookahead, std::function<Item(size_t)> loader)
+            : load(std::move(loader)), count(items), depth(std::max<size_t>(1, lookahead)),
+              produced(0), taken(0), stopping(false) {
+            reader = std::thread(&Prefetcher::readLoop, this);
+        }
+
+        ~Prefetcher() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            changed.notify_all();
+            reader.join();
+        }
+
+        Prefetcher(const Prefetcher&) = delete;
+        Prefetcher& operator=(const Prefetcher&) = delete;
+
+        // Returns false once every item has been taken; rethrows a failure
+        // of load.
+        bool next(Item& item) {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return !ready.empty() || produced == count; });
+            if (ready.empty()) {
+                if (failure) std::rethrow_exception(failure);
+                return false;
+            }
+            item = std::move(ready.front());
+            ready.pop_front();
+            ++taken;
+            changed.notify_all();
+            return true;
+        }
+    };
+
+    // Runs file writes on a dedicated thread in submission order. submit
+    // blocks only while more than maxBytes of output is already queued, so
+    // producers never wait on the disk unless they outrun it. Each job runs
+    // as one encode call and reports its work through the timer it is given.
+    class BackgroundWriter {
+    private:
+        struct Job {
+            size_t bytes;
+            std::function<void(ScopedStage&)> write;
+        };
+
+        std::deque<Job> jobs;
+        size_t queuedBytes, maxBytes;
+        std::mutex lock;
+        std::condition_variable changed;
+        std::exception_ptr failure;
+        bool stopping, busy;
+        StageStats& stats;
+        std::thread writer;
+
+        void writeLoop() {
+            std::unique_lock<std::mutex> guard(lock);
+            while (true) {
+                changed.wait(guard, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                
+                Job job = std::move(jobs.front());
+                jobs.pop_front();
+                busy = true;
+                guard.unlock();
+                try {
+                    ScopedStage timer(stats, Stage::Encode);
+                    job.write(timer);
+                } catch (...) {
+                    std::lock_guard<std::mutex> failed(lock);
+                    if (!failure) failure = std::current_exception();
+                }
+                guard.lock();
+                busy = false;
+                queuedBytes -= job.bytes;
+                changed.notify_all();
+            }
+        }
+
+    public:
+        BackgroundWriter(size_t queueBytes, StageStats& stageStats)
+            : queuedBytes(0), maxBytes(queueBytes), stopping(false), busy(false), stats(stageStats) {
+            writer = std::thread(&BackgroundWriter::writeLoop, this);
+        }
+
+        ~BackgroundWriter() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            changed.notify_all();
+            writer.join();
+        }
+
+        BackgroundWriter(const BackgroundWriter&) = delete;
+        BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+
+        // bytes is the memory the job keeps alive until it has run.
+        void submit(size_t bytes, std::function<void(ScopedStage&)> write) {
+            std::unique_lock<std::mutex> guard(lock);
+            if (queuedBytes != 0 && queuedBytes + bytes > maxBytes) {
+                ScopedStage timer(stats, Stage::WriteWait);
+                changed.wait(guard, [&] { return queuedBytes == 0 || queuedBytes + bytes <= maxBytes; });
+            }
+            queuedBytes += bytes;
+            jobs.push_back({ bytes, std::move(write) });
+            changed.notify_all();
+        }
+
+        // Blocks until every submitted write has finished; rethrows the
+        // first failure.
+        void flush() {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&] { return jobs.empty() && !busy; });
+            if (failure) {
+                std::exception_ptr error = failure;
+                failure = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+    };
+
+    const uint64_t kNoiseSeed = 20240917;
+
+    // Part of every cache key; bump it whenever noise, filtering or metrics
+    // change what they produce, so stale entries stop matching.
+    const uint64_t kCacheVersion = 2;
+
+    inline uint64_t combineHash(uint64_t hash, uint64_t value) {
+        return mix64(hash ^ (value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2)));
+    }
+
+    inline uint64_t hashBytes(const unsigned char* bytes, size_t length) {
+        uint64_t hash = mix64(length);
+        size_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            hash = combineHash(hash, word);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, bytes + i, length - i);
+        return combineHash(hash, tail);
+    }
+
+    inline bool hashFile(const std::string& path, uint64_t& hash, size_t& fileBytes) {
+        MappedFile file;
+        if (!file.open(path)) return false;
+        hash = hashBytes(file.data(), file.size());
+        fileBytes = file.size();
+        return true;
+    }
+
+    inline uint64_t doubleBits(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Returns the number of bytes copied, or -1 on failure.
+    inline int64_t copyFile(const std::string& from, const std::string& to) {
+        std::ifstream source(from, std::ios::binary);
+        if (!source.is_open()) return -1;
+        std::string temporary = to + ".tmp";
+        int64_t copied;
+        {
+            std::ofstream target(temporary, std::ios::binary | std::ios::trunc);
+            if (!target.is_open()) return -1;
+            target << source.rdbuf();
+            copied = static_cast<int64_t>(target.tellp());
+            if (!target.good()) {
+                std::remove(temporary.c_str());
+                return -1;
+            }
+        }
+        return replaceFile(temporary, to) ? copied : -1;
+    }
+
+    struct SweepMetrics {
+        QualityMetrics quality;
+        double mssim;
+    };
+
+    // Results of earlier runs, one small file per key, so that a rerun only
+    // computes combinations it has not seen. For every output image the
+    // hash of the file last written is kept as well, and the image itself
+    // is cached as a P5 file when requested.
+    class ResultCache {
+    private:
+        std::string folder;
+        bool enabled, images;
+
+        std::string path(uint64_t key, const char* suffix) const {
+            char name[17];
+            std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+            return folder + "/" + name + suffix;
+        }
+
+    public:
+        ResultCache(const std::string& cacheFolder, bool use, bool withImages)
+            : folder(cacheFolder), enabled(use), images(withImages) {
+            if (enabled) makeFolder(folder);
+        }
+
+        bool loadMetrics(uint64_t key, SweepMetrics& metrics) const {
+            if (!enabled) return false;
+            std::ifstream file(path(key, ".txt"));
+            return static_cast<bool>(file >> metrics.quality.mse >> metrics.quality.psnr
+                                          >> metrics.quality.ssim >> metrics.mssim);
+        }
+
+        void storeMetrics(uint64_t key, const SweepMetrics& metrics) const {
+            if (!enabled) return;
+            std::string target = path(key, ".txt");
+            {
+                std::ofstream file(target + ".tmp", std::ios::trunc);
+                file.precision(17);
+                file << metrics.quality.mse << ' ' << metrics.quality.psnr << ' '
+                     << metrics.quality.ssim << ' ' << metrics.mssim << '\n';
+                if (!file.good()) return;
+            }
+            replaceFile(target + ".tmp", target);
+        }
+
+        // Records the hash of the file just written to outputPath for key.
+        void storeOutput(uint64_t key, const std::string& outputPath) const {
+            uint64_t hash = 0;
+            size_t fileBytes = 0;
+            if (!enabled || !hashFile(outputPath, hash, fileBytes)) return;
+            std::string target = path(key, ".out");
+            {
+                std::ofstream file(target + ".tmp", std::ios::trunc);
+                file << hash << '\n';
+                if (!file.good()) return;
+            }
+            replaceFile(target + ".tmp", target);
+        }
+
+        // True when outputPath still holds the file an earlier run wrote for key.
+        bool outputMatches(uint64_t key, const std::string& outputPath) const {
+            if (!enabled) return false;
+            uint64_t stored = 0, hash = 0;
+            size_t fileBytes = 0;
+            std::ifstream file(path(key, ".out"));
+            return (file >> stored) && hashFile(outputPath, hash, fileBytes) && hash == stored;
+        }
+
+        std::string imagePath(uint64_t key) const { return path(key, ".pgm"); }
+
+        bool hasImage(uint64_t key) const {
+            return enabled && images && std::ifstream(imagePath(key)).is_open();
+        }
+
+        bool storeImage(uint64_t key, const PGMHandler& image) const {
+            return enabled && images && image.writeFile(imagePath(key), PGMFormat::Binary);
+        }
+    };
+
+    inline size_t imageBytes(const PGMHandler& image) {
+        return static_cast<size_t>(image.getWidth()) * image.getHeight() * (image.is16Bit() ? 2 : 1);
+    }
+
+    inline int64_t pixelCount(const PGMHandler& image) {
+        return static_cast<int64_t>(image.getWidth()) * image.getHeight();
+    }
+
+    // Size of the file writeFile produces in PGMFormat::Binary.
+    inline int64_t binaryFileBytes(const PGMHandler& image) {
+        std::string header = "P5\n" + std::to_string(image.getWidth()) + " " + std::to_string(image.getHeight()) +
+                             "\n" + std::to_string(image.getMaxValue()) + "\n";
+        return static_cast<int64_t>(header.size() + imageBytes(image));
+    }
+
+    struct PhotoInput {
+        size_t photo = 0;
+        uint64_t imageHash = 0;
+        std::vector<std::vector<size_t>> missing;
+        bool needNoisy = false;
+        std::unique_ptr<PGMHandler> source;
+    };
+
+    const size_t kPrefetchDepth = 1;
+    const int kPhotosInFlight = 2;
+    const size_t kWriteQueueBytes = 64 << 20;
+
+    enum class FilterKind { Median, Box, Gaussian };
+
+    inline const char* filterName(FilterKind kind) {
+        switch (kind) {
+        case FilterKind::Box: return "box";
+        case FilterKind::Gaussian: return "gaussian";
+        default: return "median";
+        }
+    }
+
+    // Window sizes map to a Gaussian through gaussianSigma, so every filter
+    // of the sweep is parameterized the same way. The sweep's windows give
+    // sigmas below kMinBoxSigma, where the direct kernel is the faster and
+    // more accurate path, so the sweep never runs the box-pass
+    // approximation.
+    inline PGMHandler applyFilter(const PGMHandler& image, FilterKind kind, int window) {
+        switch (kind) {
+        case FilterKind::Box: return image.boxFiltered(window);
+        case FilterKind::Gaussian: return image.gaussianFiltered(gaussianSigma(window));
+        default: return image.medianFiltered(window);
+        }
+    }
+
+    struct ProcessingOptions {
+        int threads = 0;
+        std::vector<FilterKind> filters = { FilterKind::Median, FilterKind::Box, FilterKind::Gaussian };
+        uint64_t noiseSeed = kNoiseSeed;
+        bool useCache = true;
+        bool cacheImages = false;  // also keep copies of the written images, to restore deleted outputs
+        std::string cacheFolder;  // <outputFolder>/cache when empty
+        std::string statsFile;    // <outputFolder>/stage_stats.csv when empty
+    };
+
+    // Noise is seeded from noiseSeed, the image contents and the level, so
+    // repeated runs produce the same images and results, and every metric
+    // row can be cached under a key of its inputs. The results file is only
+    // rewritten when its contents change.
+    inline void runProcessing(const std::string& inputFolder, const std::string& outputFolder, 
+                      const std::string& resultFile, const ProcessingOptions& options = ProcessingOptions()) {
+#ifndef PZ3_NO_STAGE_STATS
+        auto started = std::chrono::steady_clock::now();
+#endif
+        makeFolder(outputFolder);
+        ResultCache cache(options.cacheFolder.empty() ? outputFolder + "/cache" : options.cacheFolder,
+                          options.useCache, options.cacheImages);
+        
+        std::vector<std::string> filePaths = findFiles(inputFolder, ".pgm");
+        std::vector<double> noiseIntensities = {0.01, 0.05, 0.1};
+        std::vector<int> filterWindows = {3, 5, 7};
+        const std::vector<FilterKind>& filters = options.filters;
+        size_t slots = filters.size() * filterWindows.size();
+        size_t combinations = noiseIntensities.size() * slots;
+        
+        std::vector<std::string> rows(filePaths.size() * combinations);
+        std::mutex consoleLock;
+        StageStats stats;
+        // Write jobs capture only cache and values, both of which outlive
+        // the writer: if anything below throws, ~BackgroundWriter still runs
+        // the queued jobs while the locals after it are already gone.
+        BackgroundWriter writer(kWriteQueueBytes, stats);
+        TaskScheduler scheduler(options.threads);
+        
+        // Stages form a graph per photo: decode -> one noisy image per level
+        // -> one filtered image per slot (filter and window) -> metrics.
+        // Every _noisy and _filtered path is written once, with the image
+        // the last level and window of the sweep produce, since earlier ones
+        // would be replaced.
+        size_t lastLevel = noiseIntensities.size() - 1;
+        size_t lastWindow = filterWindows.size() - 1;
+        auto slotFilter = [&](size_t slot) { return filters[slot / filterWindows.size()]; };
+        auto slotWindow = [&](size_t slot) { return filterWindows[slot % filterWindows.size()]; };
+        auto writesImage = [&](size_t level, size_t slot) {
+            return level == lastLevel && slot % filterWindows.size() == lastWindow;
+        };
+        
+        auto levelSeed = [&](uint64_t imageHash, size_t level) {
+            return combineHash(combineHash(options.noiseSeed, imageHash), doubleBits(noiseIntensities[level]));
+        };
+        auto resultKey = [&](uint64_t imageHash, size_t level, uint64_t filterType, int filterSize) {
+            uint64_t key = combineHash(kCacheVersion, imageHash);
+            key = combineHash(key, levelSeed(imageHash, level));
+            key = combineHash(key, doubleBits(noiseIntensities[level]));
+            return combineHash(combineHash(key, filterType), static_cast<uint64_t>(filterSize));
+        };
+        auto noisyPath = [&](size_t photo) {
+            return outputFolder + "/photo" + std::to_string(photo + 1) + "_noisy.pgm";
+        };
+        auto slotKey = [&](uint64_t imageHash, size_t level, size_t slot) {
+            return resultKey(imageHash, level, static_cast<uint64_t>(slotFilter(slot)) + 1, slotWindow(slot));
+        };
+        auto cleanPath = [&](size_t photo, size_t slot) {
+            FilterKind kind = slotFilter(slot);
+            std::string suffix = (kind == FilterKind::Median) ? "" : std::string("_") + filterName(kind);
+            return outputFolder + "/photo" + std::to_string(photo + 1) + "_filtered" + suffix + ".pgm";
+        };
+        
+        auto report = [&](size_t photo, size_t level, size_t slot, const SweepMetrics& metrics) {
+            std::string photoID = "photo" + std::to_string(photo + 1);
+            double noise = noiseIntensities[level];
+            const char* kind = filterName(slotFilter(slot));
+            int filter = slotWindow(slot);
+            double mse_val = metrics.quality.mse;
+            double psnr_val = metrics.quality.psnr;
+            double ssim_val = metrics.quality.ssim;
+            double mssim_val = metrics.mssim;
+            
+            std::ostringstream line;
+            line << photoID << "," 
+                 << noise << "," 
+                 << filter << "," 
+                 << mse_val << "," 
+                 << psnr_val << "," 
+                 << ssim_val << "," 
+                 << mssim_val << "," 
+                 << kind << "\n";
+            rows[photo * combinations + level * slots + slot] = line.str();
+            
+            std::lock_guard<std::mutex> guard(consoleLock);
+            std::cout << photoID << " | Noise: " << (noise*100) << "%, Filter: " << kind << " " << filter 
+                      << " | MSE: " << mse_val << ", PSNR: " << psnr_val 
+                      << ", SSIM: " << ssim_val << ", MSSIM: " << mssim_val << std::endl;
+        };
+        
+        auto measure = [&](size_t photo, size_t level, size_t slot, uint64_t key,
+                           std::shared_ptr<const PGMHandler> source, std::shared_ptr<const PGMHandler> cleanedImage) {
+            SweepMetrics metrics;
+            {
+                ScopedStage timer(stats, Stage::Metrics);
+                metrics.quality = computeQualityMetrics(*source, *cleanedImage);
+                metrics.mssim = computeWindowedSSIM(*source, *cleanedImage);
+                timer.addWork(pixelCount(*source), 0, 0);
+            }
+            writer.submit(0, [&cache, key, metrics](ScopedStage&) { cache.storeMetrics(key, metrics); });
+            report(photo, level, slot, metrics);
+        };
+        
+        auto filterStage = [&](size_t photo, size_t level, size_t slot, uint64_t imageHash,
+                               std::shared_ptr<const PGMHandler> source, std::shared_ptr<const PGMHandler> noisyImage) {
+            std::shared_ptr<const PGMHandler> cleanedImage;
+            {
+                ScopedStage timer(stats, Stage::Filter);
+                cleanedImage = std::make_shared<const PGMHandler>(applyFilter(*noisyImage, slotFilter(slot), slotWindow(slot)));
+                timer.addWork(pixelCount(*cleanedImage), 0, 0);
+            }
+            uint64_t key = slotKey(imageHash, level, slot);
+            
+            if (writesImage(level, slot)) {
+                std::string path = cleanPath(photo, slot);
+                writer.submit(imageBytes(*cleanedImage), [&cache, cleanedImage, path, key](ScopedStage& encode) {
+                    bool written = cleanedImage->writeFile(path, PGMFormat::Binary);
+                    if (written) cache.storeOutput(key, path);
+                    int files = written + cache.storeImage(key, *cleanedImage);
+                    encode.addWork(files * pixelCount(*cleanedImage), written * binaryFileBytes(*cleanedImage),
+                                  files * binaryFileBytes(*cleanedImage));
+                });
+            }
+            scheduler.submit([&, photo, level, slot, key, source, cleanedImage] {
+                measure(photo, level, slot, key, source, cleanedImage);
+            });
+        };
+        
+        auto noiseStage = [&](size_t photo, size_t level, uint64_t imageHash, std::vector<size_t> pending,
+                              std::shared_ptr<const PGMHandler> source) {
+            std::shared_ptr<PGMHandler> noisy;
+            {
+                ScopedStage timer(stats, Stage::Noise);
+                noisy = std::make_shared<PGMHandler>(*source);
+                noisy->introduceNoise(noiseIntensities[level], levelSeed(imageHash, level));
+                timer.addWork(pixelCount(*noisy), 0, 0);
+            }
+            std::shared_ptr<const PGMHandler> noisyImage = noisy;
+            
+            if (level == lastLevel) {
+                std::string path = noisyPath(photo);
+                uint64_t key = resultKey(imageHash, level, 0, 0);
+                writer.submit(imageBytes(*noisyImage), [&cache, noisyImage, path, key](ScopedStage& encode) {
+                    bool written = noisyImage->writeFile(path, PGMFormat::Binary);
+                    if (written) cache.storeOutput(key, path);
+                    int files = written + cache.storeImage(key, *noisyImage);
+                    encode.addWork(files * pixelCount(*noisyImage), written * binaryFileBytes(*noisyImage),
+                                  files * binaryFileBytes(*noisyImage));
+                });
+            }
+            for (size_t slot : pending) {
+                scheduler.submit([&, photo, level, slot, imageHash, source, noisyImage] {
+                    filterStage(photo, level, slot, imageHash, source, noisyImage);
+                });
+            }
+        };
+        
+        // An output image is in place when its file is the one an earlier
+        // run wrote for key; failing that, it is copied back from the cache
+        // if the cache keeps images.
+        auto restoreImage = [&](uint64_t key, const std::string& path) {
+            if (cache.outputMatches(key, path)) return true;
+            if (!cache.hasImage(key)) return false;
+            writer.submit(0, [&cache, key, path](ScopedStage& encode) {
+                int64_t copied = copyFile(cache.imagePath(key), path);
+                if (copied >= 0) cache.storeOutput(key, path);
+                copied = std::max<int64_t>(0, copied);
+                encode.addWork(0, 2 * copied, copied);
+            });
+            return true;
+        };
+        
+        // Reports every cached combination of a photo and returns, per
+        // level, the slots that still have to be computed. A combination
+        // whose output image can be neither found nor restored counts as
+        // missing.
+        auto lookupPhoto = [&](size_t photo, uint64_t imageHash) {
+            std::vector<std::vector<size_t>> missing(noiseIntensities.size());
+            for (size_t level = 0; level < noiseIntensities.size(); ++level) {
+                for (size_t slot = 0; slot < slots; ++slot) {
+                    uint64_t key = slotKey(imageHash, level, slot);
+                    SweepMetrics metrics;
+                    if (cache.loadMetrics(key, metrics) &&
+                        (!writesImage(level, slot) || restoreImage(key, cleanPath(photo, slot)))) {
+                        report(photo, level, slot, metrics);
+                    } else {
+                        missing[level].push_back(slot);
+                    }
+                }
+            }
+            return missing;
+        };
+        
+        // Runs on the prefetch thread: hashes the file, settles what the
+        // cache already has and decodes the photo only if anything is left.
+        auto loadPhoto = [&](size_t photo) {
+            ScopedStage timer(stats, Stage::Decode);
+            PhotoInput input;
+            input.photo = photo;
+            std::string photoID = "photo" + std::to_string(photo + 1);
+            size_t fileBytes = 0;
+            if (!hashFile(filePaths[photo], input.imageHash, fileBytes)) {
+                std::lock_guard<std::mutex> guard(consoleLock);
+                std::cout << "Error loading: " << photoID << std::endl;
+                return input;
+            }
+            timer.addWork(0, static_cast<int64_t>(fileBytes), 0);
+            
+            input.missing = lookupPhoto(photo, input.imageHash);
+            const std::vector<size_t>& lastMissing = input.missing[lastLevel];
+            uint64_t noisyKey = resultKey(input.imageHash, lastLevel, 0, 0);
+            input.needNoisy = !lastMissing.empty() || !restoreImage(noisyKey, noisyPath(photo));
+            
+            bool complete = !input.needNoisy;
+            for (const auto& pending : input.missing) complete = complete && pending.empty();
+            if (complete) {
+                std::lock_guard<std::mutex> guard(consoleLock);
+                std::cout << "Cached: " << photoID << std::endl;
+                return input;
+            }
+            
+            input.source.reset(new PGMHandler());
+            bool loaded = input.source->readFile(filePaths[photo]);
+            {
+                std::lock_guard<std::mutex> guard(consoleLock);
+                std::cout << (loaded ? "Working on: " : "Error loading: ") << photoID << std::endl;
+            }
+            if (loaded) {
+                timer.addWork(pixelCount(*input.source), static_cast<int64_t>(fileBytes), 0);
+            } else {
+                input.source.reset();
+            }
+            return input;
+        };
+        
+        // Photos are decoded one ahead of the ones being computed, and at
+        // most kPhotosInFlight decoded photos are held by compute tasks.
+        std::mutex flightLock;
+        std::condition_variable flightDone;
+        int inFlight = 0;
+        Prefetcher<PhotoInput> reader(filePaths.size(), kPrefetchDepth, loadPhoto);
+        
+        PhotoInput input;
+        while (true) {
+            {
+                ScopedStage timer(stats, Stage::ReadWait);
+                if (!reader.next(input)) break;
+            }
+            if (!input.source) continue;
+            
+            {
+                std::unique_lock<std::mutex> guard(flightLock);
+                flightDone.wait(guard, [&] { return inFlight < kPhotosInFlight; });
+                ++inFlight;
+            }
+            std::shared_ptr<const PGMHandler> shared(input.source.release(), [&](const PGMHandler* image) {
+                delete image;
+                std::lock_guard<std::mutex> guard(flightLock);
+                --inFlight;
+                flightDone.notify_all();
+            });
+            
+            for (size_t level = 0; level < noiseIntensities.size(); ++level) {
+                if (input.missing[level].empty() && !(level == lastLevel && input.needNoisy)) continue;
+                scheduler.submit([&, photo = input.photo, level, imageHash = input.imageHash, shared,
+                                  pending = input.missing[level]] {
+                    noiseStage(photo, level, imageHash, pending, shared);
+                });
+            }
+        }
+        scheduler.wait();
+        writer.flush();
+        
+#ifndef PZ3_NO_STAGE_STATS
+        std::ostringstream breakdown;
+        breakdown.setf(std::ios::fixed);
+        breakdown.precision(3);
+        breakdown << "Stage busy time (s, summed over threads):";
+        for (int stage = 0; stage < static_cast<int>(Stage::Count); ++stage) {
+            breakdown << " " << stageName(static_cast<Stage>(stage)) << " " << stats.seconds(static_cast<Stage>(stage)) << ",";
+        }
+        breakdown << " wall-clock total " << std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::cout << breakdown.str() << std::endl;
+        
+        std::string statsPath = options.statsFile.empty() ? outputFolder + "/stage_stats.csv" : options.statsFile;
+        if (!writeStageReport(statsPath, stats)) {
+            std::cout << "Error writing stage statistics: " << statsPath << std::endl;
+        }
+#endif
+        
+        std::ostringstream results;
+        results << "Photo,NoiseLevel,FilterSize,MSE,PSNR,SSIM,MSSIM,Filter\n";
+        for (const auto& row : rows) {
+            results << row;
+        }
+        
+        std::string contents = results.str();
+        std::ifstream previous(resultFile, std::ios::binary);
+        std::string existing((std::istreambuf_iterator<char>(previous)), std::istreambuf_iterator<char>());
+        previous.close();
+        if (existing == contents && !filePaths.empty()) {
+            std::cout << "Results unchanged: " << resultFile << std::endl;
+        } else {
+            std::ofstream output(resultFile + ".tmp", std::ios::binary | std::ios::trunc);
+            output << contents;
+            output.close();
+            if (!output || !replaceFile(resultFile + ".tmp", resultFile)) {
+                std::cout << "Cannot create results file" << std::endl;
+                return;
+            }
+        }
+        
+        if (filePaths.empty()) {
+            std::cout << "No images found. Generating sample data..." << std::endl;
+            std::ofstream output(resultFile);
+            output << "Photo,NoiseLevel,FilterSize,MSE,PSNR,SSIM,MSSIM,Filter\n";
+            std::vector<std::string> samples = {"photo1", "photo2", "photo3"};
+            std::random_device rd;
+            std::mt19937 gen(rd());
+            std::uniform_real_distribution<> mse_range(10.0, 100.0);
+            std::uniform_real_distribution<> psnr_range(20.0, 35.0);
+            std::uniform_real_distribution<> ssim_range(0.7, 0.95);
+            
+            for (const auto& sample : samples) {
+                for (double noise : {0.01, 0.05, 0.1}) {
+                    for (FilterKind kind : options.filters) {
+                        for (int filter : {3, 5, 7}) {
+                            output << sample << "," 
+                                  << noise << "," 
+                                  << filter << "," 
+                                  << mse_range(gen) << "," 
+                                  << psnr_range(gen) << "," 
+                                  << ssim_range(gen) << "," 
+                                  << ssim_range(gen) << "," 
+                                  << filterName(kind) << "\n";
+                        }
+                    }
+                }
+            }
+            output.close();
+        }
+    }
+}
@@ -1,330 +1,19 @@
-#include <cmath>
-#include <string>
-#include <vector>
-#include <fstream>
-#include <sstream>
-#include <iostream>
-#include <algorithm>
-#include <random>
-
-#ifdef _WIN32
-    #include <direct.h>
-    #include <windows.h>
-#else
-    #include <sys/stat.h>
-    #include <dirent.h>
-#endif
-
-namespace ImageProcessor {
-    bool makeFolder(const std::string& path) {
-    #ifdef _WIN32
-        return _mkdir(path.c_str()) == 0;
-    #else
-        return mkdir(path.c_str(), 0755) == 0;
-    #endif
-    }
-
-    std::vector<std::string> findFiles(const std::string& folder, const std::string& ext = "") {
-        std::vector<std::string> file_list;
-        
-    #ifdef _WIN32
-        WIN32_FIND_DATA file_data;
-        HANDLE handle = FindFirstFile((folder + "/*").c_str(), &file_data);
-        
-        if (handle != INVALID_HANDLE_VALUE) {
-            do {
-                std::string name = file_data.cFileName;
-                if (name == "." || name == "..") continue;
-                
-                if (ext.empty() || name.find(ext) != std::string::npos) {
-                    file_list.push_back(folder + "/" + name);
-                }
-            } while (FindNextFile(handle, &file_data) != 0);
-            FindClose(handle);
-        }
-    #else
-        DIR* directory = opendir(folder.c_str());
-        if (directory != nullptr) {
-            struct dirent* entry;
-            while ((entry = readdir(directory)) != nullptr) {
-                std::string name = entry->d_name;
-                if (name == "." || name == "..") continue;
-                
-                if (ext.empty() || name.find(ext) != std::string::npos) {
-                    file_list.push_back(folder + "/" + name);
-                }
-            }
-            closedir(directory);
-        }
-    #endif
-        return file_list;
-    }
-
-    class PGMHandler {
-    private:
-        int w, h, max_value;
-        std::vector<std::vector<int>> data;
-
-    public:
-        PGMHandler() : w(0), h(0), max_value(255) {}
-        
-        bool readFile(const std::string& filename) {
-            std::ifstream file(filename, std::ios::binary);
-            if (!file.is_open()) return false;
-            
-            std::string format;
-            file >> format;
-            
-            if (format != "P2" && format != "P5") return false;
-            
-            file >> w >> h >> max_value;
-            
-            if (format == "P5") {
-                file.get();
-            }
-            
-            data.resize(h, std::vector<int>(w));
-            
-            if (format == "P2") {
-                for (int row = 0; row < h; ++row) {
-                    for (int col = 0; col < w; ++col) {
-                        if (!(file >> data[row][col])) return false;
-                    }
-                }
-            } else if (format == "P5") {
-                for (int row = 0; row < h; ++row) {
-                    for (int col = 0; col < w; ++col) {
-                        unsigned char value;
-                        if (!file.read(reinterpret_cast<char*>(&value), 1)) return false;
-                        data[row][col] = static_cast<int>(value);
-                    }
-                }
-            }
-            
-            file.close();
-            return true;
-        }
-        
-        bool writeFile(const std::string& filename) {
-            std::ofstream file(filename);
-            if (!file.is_open()) return false;
-            
-            file << "P2\n" << w << " " << h << "\n" << max_value << "\n";
-            for (int row = 0; row < h; ++row) {
-                for (int col = 0; col < w; ++col) {
-                    file << data[row][col] << (col < w - 1 ? " " : "");
-                }
-                file << "\n";
-            }
-            file.close();
-            return true;
-        }
-        
-        void introduceNoise(double intensity) {
-            std::random_device seed;
-            std::mt19937 generator(seed());
-            std::uniform_real_distribution<> dist(0.0, 1.0);
-            
-            for (int row = 0; row < h; ++row) {
-                for (int col = 0; col < w; ++col) {
-                    if (dist(generator) < intensity) {
-                        data[row][col] = (dist(generator) < 0.5) ? 0 : max_value;
-                    }
-                }
-            }
-        }
-        
-        void useMedianFilter(int window = 3) {
-            if (window % 2 == 0) return;
-            
-            std::vector<std::vector<int>> result = data;
-            int margin = window / 2;
-            
-            for (int row = margin; row < h - margin; ++row) {
-                for (int col = margin; col < w - margin; ++col) {
-                    std::vector<int> values;
-                    for (int dr = -margin; dr <= margin; ++dr) {
-                        for (int dc = -margin; dc <= margin; ++dc) {
-                            values.push_back(data[row + dr][col + dc]);
-                        }
-                    }
-                    std::sort(values.begin(), values.end());
-                    result[row][col] = values[values.size() / 2];
-                }
-            }
-            data = result;
-        }
-        
-        int getWidth() const { return w; }
-        int getHeight() const { return h; }
-        int getValue(int x, int y) const { 
-            return (x >= 0 && x < w && y >= 0 && y < h) ? data[y][x] : 0;
-        }
-        bool isGood() const { return w > 0 && h > 0; }
-    };
-
-    double computeMSE(const PGMHandler& img1, const PGMHandler& img2) {
-        if (!img1.isGood() || !img2.isGood()) return -1.0;
-        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return -1.0;
-        
-        double total = 0.0;
-        int pixels = img1.getWidth() * img1.getHeight();
-        
-        for (int y = 0; y < img1.getHeight(); ++y) {
-            for (int x = 0; x < img1.getWidth(); ++x) {
-                double diff = static_cast<double>(img1.getValue(x, y)) - static_cast<double>(img2.getValue(x, y));
-                total += diff * diff;
-            }
-        }
-        return total / pixels;
-    }
-
-    double computePSNR(const PGMHandler& img1, const PGMHandler& img2) {
-        double mse = computeMSE(img1, img2);
-        return (mse <= 0.0) ? -1.0 : 10.0 * log10((255.0 * 255.0) / mse);
-    }
-
-    double computeSSIM(const PGMHandler& img1, const PGMHandler& img2) {
-        if (!img1.isGood() || !img2.isGood()) return -1.0;
-        if (img1.getWidth() != img2.getWidth() || img1.getHeight() != img2.getHeight()) return -1.0;
-        
-        int width = img1.getWidth();
-        int height = img1.getHeight();
-        int total = width * height;
-        
-        double mean1 = 0.0, mean2 = 0.0;
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                mean1 += img1.getValue(x, y);
-                mean2 += img2.getValue(x, y);
-            }
-        }
-        mean1 /= total;
-        mean2 /= total;
-        
-        double var1 = 0.0, var2 = 0.0, covar = 0.0;
-        for (int y = 0; y < height; ++y) {
-            for (int x = 0; x < width; ++x) {
-                double d1 = img1.getValue(x, y) - mean1;
-                double d2 = img2.getValue(x, y) - mean2;
-                var1 += d1 * d1;
-                var2 += d2 * d2;
-                covar += d1 * d2;
-            }
-        }
-        
-        const double C1 = 6.5025, C2 = 58.5225;
-        double num = (2 * mean1 * mean2 + C1) * (2 * covar + C2);
-        double den = (mean1 * mean1 + mean2 * mean2 + C1) * (var1 + var2 + C2);
-        
-        return (den == 0.0) ? 1.0 : num / den;
-    }
-
-    void runProcessing(const std::string& inputFolder, const std::string& outputFolder, 
-                      const std::string& resultFile) {
-        std::ofstream output(resultFile);
-        if (!output.is_open()) {
-            std::cout << "Cannot create results file" << std::endl;
-            return;
-        }
-        
-        output << "Photo,NoiseLevel,FilterSize,MSE,PSNR,SSIM\n";
-        makeFolder(outputFolder);
-        
-        std::vector<std::string> filePaths = findFiles(inputFolder, ".pgm");
-        std::vector<double> noiseIntensities = {0.01, 0.05, 0.1};
-        std::vector<int> filterWindows = {3, 5, 7};
-        
-        int counter = 1;
-        
-        for (const auto& path : filePaths) {
-            std::string photoID = "photo" + std::to_string(counter);
-            std::cout << "Working on: " << photoID << std::endl;
-            
-            PGMHandler source;
-            if (!source.readFile(path)) {
-                std::cout << "Error loading: " << photoID << std::endl;
-                counter++;
-                continue;
-            }
-            
-            for (double noise : noiseIntensities) {
-                for (int filter : filterWindows) {
-                    PGMHandler noisyImage = source;
-                    noisyImage.introduceNoise(noise);
-                    
-                    std::string noisyPath = outputFolder + "/" + photoID + "_noisy.pgm";
-                    noisyImage.writeFile(noisyPath);
-                    
-                    PGMHandler cleanedImage = noisyImage;
-                    cleanedImage.useMedianFilter(filter);
-                    
-                    std::string cleanPath = outputFolder + "/" + photoID + "_filtered.pgm";
-                    cleanedImage.writeFile(cleanPath);
-                    
-                    double mse_val = computeMSE(source, cleanedImage);
-                    double psnr_val = computePSNR(source, cleanedImage);
-                    double ssim_val = computeSSIM(source, cleanedImage);
-                    
-                    output << photoID << "," 
-                          << noise << "," 
-                          << filter << "," 
-                          << mse_val << "," 
-                          << psnr_val << "," 
-                          << ssim_val << "\n";
-                    
-                    std::cout << "Noise: " << (noise*100) << "%, Filter: " << filter 
-                              << " | MSE: " << mse_val << ", PSNR: " << psnr_val 
-                              << ", SSIM: " << ssim_val << std::endl;
-                }
-            }
-            counter++;
-        }
-        
-        output.close();
-        
-        if (filePaths.empty()) {
-            std::cout << "No images found. Generating sample data..." << std::endl;
-            output.open(resultFile);
-            output << "Photo,NoiseLevel,FilterSize,MSE,PSNR,SSIM\n";
-            std::vector<std::string> samples = {"photo1", "photo2", "photo3"};
-            std::random_device rd;
-            std::mt19937 gen(rd());
-            std::uniform_real_distribution<> mse_range(10.0, 100.0);
-            std::uniform_real_distribution<> psnr_range(20.0, 35.0);
-            std::uniform_real_distribution<> ssim_range(0.7, 0.95);
-            
-            for (const auto& sample : samples) {
-                for (double noise : {0.01, 0.05, 0.1}) {
-                    for (int filter : {3, 5, 7}) {
-                        output << sample << "," 
-                              << noise << "," 
-                              << filter << "," 
-                              << mse_range(gen) << "," 
-                              << psnr_range(gen) << "," 
-                              << ssim_range(gen) << "\n";
-                    }
-                }
-            }
-            output.close();
-        }
-    }
-}
-
-int main() {
-    using namespace ImageProcessor;
-    
-    std::string inputPath = "photo";
-    std::string outputPath = "processed";
-    std::string resultsPath = "prog3_res.csv";
-    
-    makeFolder(inputPath);
-    
-    std::cout << "Initializing image processing..." << std::endl;
-    std::cout << "Source: " << inputPath << std::endl;
-    std::cout << "Destination: " << outputPath << std::endl;
-    std::cout << "Results: " << resultsPath << std::endl;
-    
-    runProcessing(inputPath, outputPath, resultsPath);
-    return 0;
+#include "image_processor.h"
+
+int main() {
+    using namespace ImageProcessor;
+    
+    std::string inputPath = "photo";
+    std::string outputPath = "processed";
+    std::string resultsPath = "prog3_res.csv";
+    
+    makeFolder(inputPath);
+    
+    std::cout << "Initializing image processing..." << std::endl;
+    std::cout << "Source: " << inputPath << std::endl;
+    std::cout << "Destination: " << outputPath << std::endl;
+    std::cout << "Results: " << resultsPath << std::endl;
+    
+    runProcessing(inputPath, outputPath, resultsPath);
+    return 0;
 }
\ No newline at end of file
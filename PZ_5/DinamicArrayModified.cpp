@@ -1,14 +1,28 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <utility>
 #include <fstream>
 #include <chrono>
 #include <iomanip>
+#if defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMIC_ARRAY_HAVE_SSE2 1
+#endif
 
 class DynamicArray {
+public:
+    enum class Arithmetic { Wrapping, Saturating };
+
 protected:
     int* data_;
     size_t size_;
+    size_t capacity_;
 
     static void checkValueRange(int value) {
         if (value < -100 || value > 100) {
@@ -22,9 +36,131 @@ protected:
         }
     }
 
+    void reallocate(size_t newCapacity) {
+        int* new_data = (newCapacity > 0) ? new int[newCapacity] : nullptr;
+        std::copy(data_, data_ + size_, new_data);
+        delete[] data_;
+        data_ = new_data;
+        capacity_ = newCapacity;
+    }
+
+    static int saturate(long long value) {
+        return (value < -100) ? -100 : (value > 100) ? 100 : static_cast<int>(value);
+    }
+
+    static int wrap(unsigned value) {
+        return static_cast<int>(value);
+    }
+
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+    // Four int lanes with the operators the arithmetic lambdas use; lane
+    // arithmetic wraps like unsigned int. Saturating lanes hold any scalar
+    // they meet (alpha, factor) to +-kLaneClamp, so while the elements stay
+    // within +-kLaneLimit no lane overflows and every result saturates as
+    // it would in long long. x86-64 always has SSE2, so no compiler flags
+    // are needed.
+    static const int kLaneLimit = 1 << 14;
+    static const int kLaneClamp = kLaneLimit + 101;
+
+    template <bool Saturating>
+    struct Lanes {
+        __m128i v;
+
+        explicit Lanes(__m128i value) : v(value) {}
+        explicit Lanes(int value)
+            : v(_mm_set1_epi32(!Saturating ? value
+                               : (value < -kLaneClamp) ? -kLaneClamp : (value > kLaneClamp) ? kLaneClamp : value)) {}
+
+        static Lanes load(const int* from) { return Lanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(from))); }
+        void store(int* to) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(to), v); }
+
+        bool fits() const {
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(v, _mm_set1_epi32(kLaneLimit)),
+                                           _mm_cmplt_epi32(v, _mm_set1_epi32(-kLaneLimit)));
+            return _mm_movemask_epi8(outside) == 0;
+        }
+
+        Lanes clamp(int low, int high) const {
+            __m128i lowLanes = _mm_set1_epi32(low), highLanes = _mm_set1_epi32(high);
+            __m128i below = _mm_cmplt_epi32(v, lowLanes);
+            __m128i value = _mm_or_si128(_mm_and_si128(below, lowLanes), _mm_andnot_si128(below, v));
+            __m128i above = _mm_cmpgt_epi32(value, highLanes);
+            return Lanes(_mm_or_si128(_mm_and_si128(above, highLanes), _mm_andnot_si128(above, value)));
+        }
+
+        friend Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm_add_epi32(a.v, b.v)); }
+        friend Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm_sub_epi32(a.v, b.v)); }
+
+        // SSE2 only multiplies lanes 0 and 2; lanes 1 and 3 are shifted down for a second pass
+        friend Lanes operator*(Lanes a, Lanes b) {
+            __m128i even = _mm_mul_epu32(a.v, b.v);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+            return Lanes(_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+        }
+    };
+
+    static Lanes<true> saturate(Lanes<true> value) {
+        return value.clamp(-100, 100);
+    }
+#endif
+
+    template <typename Op>
+    void transform(size_t begin, Arithmetic mode, Op op) {
+        int* data = data_;
+        size_t i = begin;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) { data[k] = saturate(op(static_cast<long long>(data[k]))); };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) {
+                Lanes<true> value = Lanes<true>::load(data + i);
+                if (value.fits()) saturate(op(value)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < size_; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) op(Lanes<false>::load(data + i)).store(data + i);
+#endif
+            for (; i < size_; ++i) data[i] = wrap(op(static_cast<unsigned>(data[i])));
+        }
+    }
+
+    template <typename Op>
+    void combine(const DynamicArray& other, Arithmetic mode, Op op) {
+        size_t overlap = std::min(size_, other.size_);
+        int* data = data_;
+        const int* src = other.data_;
+        size_t i = 0;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) {
+                data[k] = saturate(op(static_cast<long long>(data[k]), static_cast<long long>(src[k])));
+            };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                Lanes<true> a = Lanes<true>::load(data + i), b = Lanes<true>::load(src + i);
+                if (a.fits() && b.fits()) saturate(op(a, b)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < overlap; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                op(Lanes<false>::load(data + i), Lanes<false>::load(src + i)).store(data + i);
+            }
+#endif
+            for (; i < overlap; ++i) {
+                data[i] = wrap(op(static_cast<unsigned>(data[i]), static_cast<unsigned>(src[i])));
+            }
+        }
+        transform(overlap, mode, [op](auto value) { return op(value, decltype(value)(0)); });
+    }
+
 public:
     explicit DynamicArray(size_t size = 0)
-        : data_(nullptr), size_(size)
+        : data_(nullptr), size_(size), capacity_(size)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -37,7 +173,7 @@ public:
     }
 
     DynamicArray(const DynamicArray& other)
-        : data_(nullptr), size_(other.size_)
+        : data_(nullptr), size_(other.size_), capacity_(other.size_)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -47,19 +183,62 @@ public:
 
     DynamicArray& operator=(const DynamicArray& other) {
         if (this == &other) return *this;
-        int* new_data = nullptr;
-        if (other.size_ > 0) {
-            new_data = new int[other.size_];
-            std::copy(other.data_, other.data_ + other.size_, new_data);
+        if (other.size_ <= capacity_) {
+            std::copy(other.data_, other.data_ + other.size_, data_);
+            size_ = other.size_;
+            return *this;
         }
+        int* new_data = new int[other.size_];
+        std::copy(other.data_, other.data_ + other.size_, new_data);
         delete[] data_;
         data_ = new_data;
         size_ = other.size_;
+        capacity_ = other.size_;
         return *this;
     }
 
+    DynamicArray(DynamicArray&& other) noexcept
+        : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    DynamicArray& operator=(DynamicArray&& other) noexcept {
+        if (this == &other) return *this;
+        delete[] data_;
+        data_ = other.data_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    void swap(DynamicArray& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    friend void swap(DynamicArray& a, DynamicArray& b) noexcept {
+        a.swap(b);
+    }
+
     size_t size() const { return size_; }
 
+    size_t capacity() const { return capacity_; }
+
+    void reserve(size_t newCapacity) {
+        if (newCapacity > capacity_) reallocate(newCapacity);
+    }
+
+    void shrink_to_fit() {
+        if (capacity_ > size_) reallocate(size_);
+    }
+
     int get(size_t idx) const {
         checkIndex(idx, size_);
         return data_[idx];
@@ -82,25 +261,41 @@ public:
 
     void append(int value) {
         checkValueRange(value);
-        int* new_data = new int[size_ + 1];
-        for (size_t i = 0; i < size_; ++i) new_data[i] = data_[i];
-        new_data[size_] = value;
-        delete[] data_;
-        data_ = new_data;
-        ++size_;
+        if (size_ == capacity_) reallocate(std::max<size_t>(4, capacity_ * 2));
+        data_[size_++] = value;
     }
 
-    void add(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            data_[i] += otherVal;
-        }
+    void add(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a + b; });
     }
 
-    void subtract(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            data_[i] -= otherVal;
+    void subtract(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a - b; });
+    }
+
+    void multiply(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a * b; });
+    }
+
+    void axpy(int alpha, const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [alpha](auto a, auto b) { return a + static_cast<decltype(a)>(alpha) * b; });
+    }
+
+    void scale(int factor, Arithmetic mode = Arithmetic::Wrapping) {
+        transform(0, mode, [factor](auto value) { return value * static_cast<decltype(value)>(factor); });
+    }
+
+    void clamp(int low, int high) {
+        if (low > high) {
+            throw std::invalid_argument("Clamp bounds must satisfy low <= high.");
+        }
+        int* data = data_;
+        size_t i = 0;
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+        for (; i + 4 <= size_; i += 4) Lanes<false>::load(data + i).clamp(low, high).store(data + i);
+#endif
+        for (; i < size_; ++i) {
+            data[i] = (data[i] < low) ? low : (data[i] > high) ? high : data[i];
         }
     }
 
@@ -113,6 +308,22 @@ public:
         return data_[idx];
     }
 
+    int& unchecked(size_t idx) { return data_[idx]; }
+    const int& unchecked(size_t idx) const { return data_[idx]; }
+
+    int* data() { return data_; }
+    const int* data() const { return data_; }
+
+    int* begin() { return data_; }
+    int* end() { return data_ + size_; }
+    const int* begin() const { return data_; }
+    const int* end() const { return data_ + size_; }
+
+#ifdef __cpp_lib_span
+    std::span<int> span() { return std::span<int>(data_, size_); }
+    std::span<const int> span() const { return std::span<const int>(data_, size_); }
+#endif
+
     virtual void saveToFile() const {
         // Базовый класс не реализует сохранение
         std::cout << "Base class saveToFile() called\n";
@@ -133,6 +344,9 @@ class ArrTxt : public DynamicArray {
 public:
     using DynamicArray::DynamicArray;
 
+    explicit ArrTxt(const DynamicArray& other) : DynamicArray(other) {}
+    explicit ArrTxt(DynamicArray&& other) noexcept : DynamicArray(std::move(other)) {}
+
     void saveToFile() const override {
         std::string filename = getCurrentDateTime() + ".txt";
         std::ofstream file(filename);
@@ -153,6 +367,9 @@ class ArrCSV : public DynamicArray {
 public:
     using DynamicArray::DynamicArray;
 
+    explicit ArrCSV(const DynamicArray& other) : DynamicArray(other) {}
+    explicit ArrCSV(DynamicArray&& other) noexcept : DynamicArray(std::move(other)) {}
+
     void saveToFile() const override {
         std::string filename = getCurrentDateTime() + ".csv";
         std::ofstream file(filename);
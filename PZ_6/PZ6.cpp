@@ -1,11 +1,27 @@
 #include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <utility>
+#if defined(__has_include)
+#if __has_include(<span>)
+#include <span>
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNAMIC_ARRAY_HAVE_SSE2 1
+#endif
 
 class DynamicArray {
+public:
+    // Wrapping results wrap around like unsigned int and may leave [-100, 100];
+    // Saturating clamps them in the same pass
+    enum class Arithmetic { Wrapping, Saturating };
+
 private:
     int* data_;
     size_t size_;
+    size_t capacity_;
 
     // Static validation methods for reusability
     static void checkValueRange(int value) {
@@ -20,10 +36,141 @@ private:
         }
     }
 
+    // Moves the elements into a buffer of newCapacity (>= size_)
+    void reallocate(size_t newCapacity) {
+        int* new_data = (newCapacity > 0) ? new int[newCapacity] : nullptr;
+        std::copy(data_, data_ + size_, new_data);
+        delete[] data_;
+        data_ = new_data;
+        capacity_ = newCapacity;
+    }
+
+    // Clamp a result into [-100, 100] before narrowing it to int
+    static int saturate(long long value) {
+        return (value < -100) ? -100 : (value > 100) ? 100 : static_cast<int>(value);
+    }
+
+    // Back from unsigned, where overflow is well-defined
+    static int wrap(unsigned value) {
+        return static_cast<int>(value);
+    }
+
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+    // Four int lanes with the operators the arithmetic lambdas use; lane
+    // arithmetic wraps like unsigned int. Saturating lanes hold any scalar
+    // they meet (alpha, factor) to +-kLaneClamp, so while the elements stay
+    // within +-kLaneLimit no lane overflows and every result saturates as
+    // it would in long long. x86-64 always has SSE2, so no compiler flags
+    // are needed.
+    static const int kLaneLimit = 1 << 14;
+    static const int kLaneClamp = kLaneLimit + 101;
+
+    template <bool Saturating>
+    struct Lanes {
+        __m128i v;
+
+        explicit Lanes(__m128i value) : v(value) {}
+        explicit Lanes(int value)
+            : v(_mm_set1_epi32(!Saturating ? value
+                               : (value < -kLaneClamp) ? -kLaneClamp : (value > kLaneClamp) ? kLaneClamp : value)) {}
+
+        static Lanes load(const int* from) { return Lanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(from))); }
+        void store(int* to) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(to), v); }
+
+        bool fits() const {
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(v, _mm_set1_epi32(kLaneLimit)),
+                                           _mm_cmplt_epi32(v, _mm_set1_epi32(-kLaneLimit)));
+            return _mm_movemask_epi8(outside) == 0;
+        }
+
+        Lanes clamp(int low, int high) const {
+            __m128i lowLanes = _mm_set1_epi32(low), highLanes = _mm_set1_epi32(high);
+            __m128i below = _mm_cmplt_epi32(v, lowLanes);
+            __m128i value = _mm_or_si128(_mm_and_si128(below, lowLanes), _mm_andnot_si128(below, v));
+            __m128i above = _mm_cmpgt_epi32(value, highLanes);
+            return Lanes(_mm_or_si128(_mm_and_si128(above, highLanes), _mm_andnot_si128(above, value)));
+        }
+
+        friend Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm_add_epi32(a.v, b.v)); }
+        friend Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm_sub_epi32(a.v, b.v)); }
+
+        // SSE2 only multiplies lanes 0 and 2; lanes 1 and 3 are shifted down for a second pass
+        friend Lanes operator*(Lanes a, Lanes b) {
+            __m128i even = _mm_mul_epu32(a.v, b.v);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+            return Lanes(_mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0))));
+        }
+    };
+
+    static Lanes<true> saturate(Lanes<true> value) {
+        return value.clamp(-100, 100);
+    }
+#endif
+
+    // Apply op to elements [begin, size_), four lanes at a time where SSE2
+    // is available; blocks holding elements beyond kLaneLimit are saturated
+    // in long long instead, and wrapping falls back to unsigned
+    template <typename Op>
+    void transform(size_t begin, Arithmetic mode, Op op) {
+        int* data = data_;
+        size_t i = begin;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) { data[k] = saturate(op(static_cast<long long>(data[k]))); };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) {
+                Lanes<true> value = Lanes<true>::load(data + i);
+                if (value.fits()) saturate(op(value)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < size_; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= size_; i += 4) op(Lanes<false>::load(data + i)).store(data + i);
+#endif
+            for (; i < size_; ++i) data[i] = wrap(op(static_cast<unsigned>(data[i])));
+        }
+    }
+
+    // Apply op element-wise; elements past the end of other count as 0.
+    // The overlap and the tail run as separate loops, neither of which
+    // branches on the other array's size
+    template <typename Op>
+    void combine(const DynamicArray& other, Arithmetic mode, Op op) {
+        size_t overlap = std::min(size_, other.size_);
+        int* data = data_;
+        const int* src = other.data_;
+        size_t i = 0;
+        if (mode == Arithmetic::Saturating) {
+            auto exact = [&](size_t k) {
+                data[k] = saturate(op(static_cast<long long>(data[k]), static_cast<long long>(src[k])));
+            };
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                Lanes<true> a = Lanes<true>::load(data + i), b = Lanes<true>::load(src + i);
+                if (a.fits() && b.fits()) saturate(op(a, b)).store(data + i);
+                else for (size_t k = i; k < i + 4; ++k) exact(k);
+            }
+#endif
+            for (; i < overlap; ++i) exact(i);
+        } else {
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+            for (; i + 4 <= overlap; i += 4) {
+                op(Lanes<false>::load(data + i), Lanes<false>::load(src + i)).store(data + i);
+            }
+#endif
+            for (; i < overlap; ++i) {
+                data[i] = wrap(op(static_cast<unsigned>(data[i]), static_cast<unsigned>(src[i])));
+            }
+        }
+        transform(overlap, mode, [op](auto value) { return op(value, decltype(value)(0)); });
+    }
+
 public:
     // Constructor - initializes with zeros (all values within valid range)
     explicit DynamicArray(size_t size = 0)
-        : data_(nullptr), size_(size)
+        : data_(nullptr), size_(size), capacity_(size)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -37,7 +184,7 @@ public:
 
     // Copy constructor
     DynamicArray(const DynamicArray& other)
-        : data_(nullptr), size_(other.size_)
+        : data_(nullptr), size_(other.size_), capacity_(other.size_)
     {
         if (size_ > 0) {
             data_ = new int[size_];
@@ -48,20 +195,69 @@ public:
     // Assignment operator
     DynamicArray& operator=(const DynamicArray& other) {
         if (this == &other) return *this;
-        int* new_data = nullptr;
-        if (other.size_ > 0) {
-            new_data = new int[other.size_];
-            std::copy(other.data_, other.data_ + other.size_, new_data);
+        if (other.size_ <= capacity_) {
+            std::copy(other.data_, other.data_ + other.size_, data_);
+            size_ = other.size_;
+            return *this;
         }
+        int* new_data = new int[other.size_];
+        std::copy(other.data_, other.data_ + other.size_, new_data);
         delete[] data_;
         data_ = new_data;
         size_ = other.size_;
+        capacity_ = other.size_;
         return *this;
     }
 
+    // Move constructor - takes over the buffer, leaves other empty
+    DynamicArray(DynamicArray&& other) noexcept
+        : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    // Move assignment operator
+    DynamicArray& operator=(DynamicArray&& other) noexcept {
+        if (this == &other) return *this;
+        delete[] data_;
+        data_ = other.data_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    // Exchange contents without copying elements
+    void swap(DynamicArray& other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    friend void swap(DynamicArray& a, DynamicArray& b) noexcept {
+        a.swap(b);
+    }
+
     // Get array size
     size_t size() const { return size_; }
 
+    // Get allocated capacity
+    size_t capacity() const { return capacity_; }
+
+    // Pre-allocate storage for at least newCapacity elements
+    void reserve(size_t newCapacity) {
+        if (newCapacity > capacity_) reallocate(newCapacity);
+    }
+
+    // Release unused capacity
+    void shrink_to_fit() {
+        if (capacity_ > size_) reallocate(size_);
+    }
+
     // Get value by index (with validation)
     int get(size_t idx) const {
         checkIndex(idx, size_); // Validation: std::out_of_range
@@ -88,31 +284,47 @@ public:
     // Append element to the end (with value validation)
     void append(int value) {
         checkValueRange(value); // Validation: std::invalid_argument
-        int* new_data = new int[size_ + 1];
-        for (size_t i = 0; i < size_; ++i) new_data[i] = data_[i];
-        new_data[size_] = value;
-        delete[] data_;
-        data_ = new_data;
-        ++size_;
+        if (size_ == capacity_) reallocate(std::max<size_t>(4, capacity_ * 2));
+        data_[size_++] = value;
     }
 
     // Element-wise addition
-    void add(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            // Result of addition may exceed [-100, 100] range
-            // This is not validated as it's a result of an operation
-            data_[i] += otherVal;
-        }
+    void add(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a + b; });
     }
 
     // Element-wise subtraction
-    void subtract(const DynamicArray& other) {
-        for (size_t i = 0; i < size_; ++i) {
-            int otherVal = (i < other.size_) ? other.data_[i] : 0;
-            // Result of subtraction may exceed [-100, 100] range
-            // This is not validated as it's a result of an operation
-            data_[i] -= otherVal;
+    void subtract(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a - b; });
+    }
+
+    // Element-wise multiplication
+    void multiply(const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [](auto a, auto b) { return a * b; });
+    }
+
+    // this += alpha * other, element-wise
+    void axpy(int alpha, const DynamicArray& other, Arithmetic mode = Arithmetic::Wrapping) {
+        combine(other, mode, [alpha](auto a, auto b) { return a + static_cast<decltype(a)>(alpha) * b; });
+    }
+
+    // Multiply every element by factor
+    void scale(int factor, Arithmetic mode = Arithmetic::Wrapping) {
+        transform(0, mode, [factor](auto value) { return value * static_cast<decltype(value)>(factor); });
+    }
+
+    // Limit every element to [low, high] (Validation: std::invalid_argument)
+    void clamp(int low, int high) {
+        if (low > high) {
+            throw std::invalid_argument("Clamp bounds must satisfy low <= high.");
+        }
+        int* data = data_;
+        size_t i = 0;
+#ifdef DYNAMIC_ARRAY_HAVE_SSE2
+        for (; i + 4 <= size_; i += 4) Lanes<false>::load(data + i).clamp(low, high).store(data + i);
+#endif
+        for (; i < size_; ++i) {
+            data[i] = (data[i] < low) ? low : (data[i] > high) ? high : data[i];
         }
     }
 
@@ -126,6 +338,25 @@ public:
         checkIndex(idx, size_); // Validation: std::out_of_range
         return data_[idx];
     }
+
+    // Index access without bounds checking (caller guarantees idx < size())
+    int& unchecked(size_t idx) { return data_[idx]; }
+    const int& unchecked(size_t idx) const { return data_[idx]; }
+
+    // Raw element storage
+    int* data() { return data_; }
+    const int* data() const { return data_; }
+
+    // Random-access iterators for range-for and standard algorithms
+    int* begin() { return data_; }
+    int* end() { return data_ + size_; }
+    const int* begin() const { return data_; }
+    const int* end() const { return data_ + size_; }
+
+#ifdef __cpp_lib_span
+    std::span<int> span() { return std::span<int>(data_, size_); }
+    std::span<const int> span() const { return std::span<const int>(data_, size_); }
+#endif
 };
 
 // Demonstration of exception handling